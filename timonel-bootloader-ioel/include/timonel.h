@@ -21,13 +21,23 @@
 // #pragma message "   >>>   Run, Timonel, run!   <<<   "
 
 // Includes
+#include <stdbool.h>
+
+// TWI driver: USI (default) or TWI peripheral, selected per device in "configs/*.ini"
+#ifndef TWI_HW_DRIVER
+#define TWI_HW_DRIVER false
+#endif /* TWI_HW_DRIVER */
+
 #include <avr/boot.h>
 #include <avr/eeprom.h>
 #include <avr/interrupt.h>
 #include <avr/wdt.h>
 #include <nb-twi-cmd.h>
+#if TWI_HW_DRIVER
+#include <nb-twihwsl-if.h>
+#else
 #include <nb-usitwisl-if.h>
-#include <stdbool.h>
+#endif  // TWI_HW_DRIVER
 #include <stdlib.h>
 
 /* ====== [   The configuration of the next optional features can be checked   ] ====== */
@@ -168,8 +178,14 @@
 #endif /* LOW_FUSE */      /* is enabled, this value is irrelevant.                               */
                            /* NOTE: This value can be set externally as a makefile option and it  */
                            /* is shown in the GETTMNLV command.                                   */
+#if defined(__AVR_ATtiny48__) | \
+    defined(__AVR_ATtiny88__)
+#define HFPLL_CLK_SRC 0xFF /* No HF PLL clock source on ATtinyX8 devices (never matches)          */
+#define RCOSC_CLK_SRC 0x0E /* RC oscillator (8 MHz) clock source low fuse value (CKSEL = 1110)    */
+#else
 #define HFPLL_CLK_SRC 0x01 /* HF PLL (16 MHz) clock source low fuse value */
 #define RCOSC_CLK_SRC 0x02 /* RC oscillator (8 MHz) clock source low fuse value */
+#endif /* ATtinyX8 */
 #define LFUSE_PRESC_BIT 7  /* Prescaler bit position in low fuse (FUSE_CKDIV8) */
 
 // Non-blocking delays
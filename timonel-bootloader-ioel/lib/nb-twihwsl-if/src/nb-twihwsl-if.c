@@ -0,0 +1,141 @@
+/*
+ *  NB hardware TWI interrupt-free driver
+ *  Author: Gustavo Casanova
+ *  .............................................
+ *  File: nb-twihwsl-if.c (Slave driver library)
+ *  .............................................
+ *  Version: 1.6 "Sandra" / 2023-04-28 "Ext-Lib"
+ *  gustavo.casanova@nicebots.com
+ *  .............................................
+ *  Same API as nb-usitwisl-if, for devices with
+ *  a TWI peripheral (ATtiny48/88)
+ *  .............................................
+ */
+
+// Includes
+#include "nb-twihwsl-if.h"
+
+// On inline builds, the driver is compiled only within the application source
+#if (!(TWI_DRIVER_INLINE) || defined(TWI_DRIVER_IMPL))
+
+// TWI driver globals
+static uint8_t rx_buffer[TWI_RX_BUFFER_SIZE];
+static uint8_t tx_buffer[TWI_TX_BUFFER_SIZE];
+static uint8_t rx_head = 0, rx_tail = 0;
+static uint8_t tx_head = 0, tx_tail = 0;
+static uint8_t rx_byte_count = 0;  // Bytes received in RX buffer
+static uint8_t tx_byte_count = 0;  // Bytes to transmit in TX buffer
+#ifndef TWI_RECEIVE_EVENT
+void (*p_receive_event)(uint8_t);  // Application receive handler
+#endif  // !TWI_RECEIVE_EVENT
+
+/* ___________________________
+  |                           |
+  |   TWI byte transmission   |
+  |___________________________|
+*/
+void TwiTransmitByte(const uint8_t data_byte) {
+    while (tx_byte_count == TWI_TX_BUFFER_SIZE) {
+    };                                               // Wait for a free spot in the buffer
+    tx_head = ((tx_head + 1) & TWI_TX_BUFFER_MASK);  // Update the TX buffer head pointer
+    tx_buffer[tx_head] = data_byte;                  // Write the data byte into the TX buffer
+    tx_byte_count++;                                 // Update TX buffer used positions counter
+}
+
+/* ___________________________
+  |                           |
+  |    TWI byte reception     |
+  |___________________________|
+*/
+uint8_t TwiReceiveByte(void) {
+    while (!rx_byte_count) {
+    };                                               // Wait until data is present in the RX buffer
+    rx_tail = ((rx_tail + 1) & TWI_RX_BUFFER_MASK);  // Update the RX buffer tail pointer
+    rx_byte_count--;                                 // Update RX buffer used positions counter
+    return rx_buffer[rx_tail];                       // Return data from the RX buffer
+}
+
+/* ___________________________
+  |                           |
+  | TWI driver initialization |
+  |___________________________|
+*/
+void TwiDriverInit(void) {
+    tx_tail = tx_head = tx_byte_count = 0;  // Flush TWI TX buffers
+    rx_tail = rx_head = rx_byte_count = 0;  // Flush TWI RX buffers
+    TWAR = (TWI_ADDR << 1);              // Slave address, general calls ignored (TWGCE cleared)
+    TWCR = ((1 << TWEA) | (1 << TWEN));  // Enable the TWI peripheral in slave mode, interrupt disabled
+}
+
+/* _____________________________________________
+  |                                             |
+  | TWI event handler (Interrupt-like function) |
+  |_____________________________________________|
+*/
+bool TwiEventHandler(void) {
+    // The TWI peripheral holds SCL low from the moment it raises TWINT until
+    // the flag is cleared at the end of this handler, so there is no hurry.
+    bool slow_ops = false;
+    switch (TW_STATUS) {
+        // Receive data mode:
+        // ==================
+        // Own address received with write bit, the data bytes
+        // that follow are appended to the RX buffer.
+        case TW_SR_DATA_ACK: {
+            rx_head = ((rx_head + 1) & TWI_RX_BUFFER_MASK);
+            rx_buffer[rx_head] = TWDR;
+            rx_byte_count++;
+            break;
+        }
+        // Send data mode:
+        // ===============
+        // Own address received with read bit: process the received data in main,
+        // then send the reply bytes queued in the TX buffer, one per event.
+        case TW_ST_SLA_ACK: {
+            // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+#ifdef TWI_RECEIVE_EVENT
+            TWI_RECEIVE_EVENT(rx_byte_count);    // Process data in main ...     >>
+#else
+            if (p_receive_event) {               //                             >>
+                p_receive_event(rx_byte_count);  // Process data in main ...     >>
+            }                                    //                             >>
+#endif  // TWI_RECEIVE_EVENT
+            // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+            // Just drop straight into TW_ST_DATA_ACK (no break) ...
+        }
+        case TW_ST_DATA_ACK: {
+            if (tx_byte_count) {
+                tx_tail = ((tx_tail + 1) & TWI_TX_BUFFER_MASK);
+                TWDR = tx_buffer[tx_tail];
+                tx_byte_count--;
+            } else {
+                TWDR = 0xFF;  // Nothing left to send, the master reads an idle bus
+            }
+            break;
+        }
+        // Reply complete: the master has read the last byte it wanted (NACK).
+        case TW_ST_DATA_NACK:
+        case TW_ST_LAST_DATA: {
+            // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+            //                                                                  >>
+            slow_ops = true;  // Enable slow operations in main!                 >>
+            //                                                                  >>
+            // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+            break;
+        }
+        // Illegal start or stop condition: release the bus and recover.
+        case TW_BUS_ERROR: {
+            TWCR = (TWI_SLAVE_ENABLE | (1 << TWSTO));
+            return false;
+        }
+        // Own address with write bit, stop or repeated start, data NACKed by
+        // this device: nothing to do but acknowledging the event.
+        default: {
+            break;
+        }
+    }
+    TWCR = TWI_SLAVE_ENABLE;  // Clear the event flag, this releases SCL
+    return slow_ops;
+}
+
+#endif  // !TWI_DRIVER_INLINE || TWI_DRIVER_IMPL
@@ -0,0 +1,84 @@
+/*
+ *  NB hardware TWI interrupt-free driver
+ *  Author: Gustavo Casanova
+ *  .............................................
+ *  File: nb-twihwsl-if.h (Slave driver headers)
+ *  .............................................
+ *  Version: 1.6 "Sandra" / 2023-04-28 "Ext-Lib"
+ *  gustavo.casanova@nicebots.com
+ *  .............................................
+ *  Same API as nb-usitwisl-if, for devices with
+ *  a TWI peripheral (ATtiny48/88)
+ *  .............................................
+ */
+
+#ifndef NB_TWIHWSL_IF_H
+#define NB_TWIHWSL_IF_H
+
+// Includes
+#include <avr/interrupt.h>
+#include <stdbool.h>
+#include <util/twi.h>
+
+#if !defined(TWCR) || !defined(TWAR)
+#error This device has no TWI peripheral, use the nb-usitwisl-if driver instead
+#endif  // !TWCR || !TWAR
+
+// Driver buffer defines
+
+// Allowed RX buffer sizes: 1, 2, 4, 8, 16, 32, 64, 128 or 256
+#ifndef TWI_RX_BUFFER_SIZE
+#define TWI_RX_BUFFER_SIZE 64
+#endif  // TWI_RX_BUFFER_SIZE
+
+#define TWI_RX_BUFFER_MASK (TWI_RX_BUFFER_SIZE - 1)
+
+#if (TWI_RX_BUFFER_SIZE & TWI_RX_BUFFER_MASK)
+#error TWI RX buffer size is not a power of 2
+#endif  // TWI_RX_BUFFER_SIZE & TWI_RX_BUFFER_MASK
+
+// Allowed TX buffer sizes: 1, 2, 4, 8, 16, 32, 64, 128 or 256
+#ifndef TWI_TX_BUFFER_SIZE
+#define TWI_TX_BUFFER_SIZE 64
+#endif  // TWI_TX_BUFFER_SIZE
+
+#define TWI_TX_BUFFER_MASK (TWI_TX_BUFFER_SIZE - 1)
+
+#if (TWI_TX_BUFFER_SIZE & TWI_TX_BUFFER_MASK)
+#error TWI TX buffer size is not a power of 2
+#endif  // TWI_TX_BUFFER_SIZE & TWI_TX_BUFFER_MASK
+
+// TWI peripheral settings
+#define TWI_SLAVE_ENABLE ((1 << TWINT) | (1 << TWEA) | (1 << TWEN)) /* Clear the event flag, keep acknowledging */
+#define TWI_EVENT_PENDING() ((TWCR >> TWINT) & true)                 /* The TWI peripheral is holding SCL low   */
+
+// Receive event binding (see nb-usitwisl-if.h)
+#ifndef TWI_DRIVER_INLINE
+#define TWI_DRIVER_INLINE false
+#endif  // TWI_DRIVER_INLINE
+
+#if (TWI_DRIVER_INLINE && !defined(TWI_RECEIVE_EVENT))
+#error TWI_DRIVER_INLINE requires setting TWI_RECEIVE_EVENT to the receive handler name
+#endif  // TWI_DRIVER_INLINE && !TWI_RECEIVE_EVENT
+
+#ifdef TWI_RECEIVE_EVENT
+#if !(TWI_DRIVER_INLINE)
+void TWI_RECEIVE_EVENT(const uint8_t received_bytes);
+#endif  // !TWI_DRIVER_INLINE
+#else
+// Function pointers (defined in the driver source)
+extern void (*p_receive_event)(uint8_t);
+#endif  // TWI_RECEIVE_EVENT
+
+// nb-usitwisl-if compatible names
+#define UsiTwiTransmitByte TwiTransmitByte
+#define UsiTwiReceiveByte TwiReceiveByte
+#define UsiTwiDriverInit TwiDriverInit
+
+// TWI driver prototypes
+void TwiTransmitByte(const uint8_t data_byte);
+uint8_t TwiReceiveByte(void);
+void TwiDriverInit(void);
+bool TwiEventHandler(void);
+
+#endif  // NB_TWIHWSL_IF_H
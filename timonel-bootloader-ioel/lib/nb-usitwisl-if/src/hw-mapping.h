@@ -3,7 +3,7 @@
  *  =================================
  *  Library hardware mapping
  *  ---------------------------------
- *  Version: 1.0.2 / 2020-09-19
+ *  Version: 1.0.3 / 2026-10-19
  *  ---------------------------------
  */
 
@@ -25,6 +25,8 @@
 // TWI_COLLISION_FLAG = Status register flag: indicates a data output collision on the bus
 // TWI_START_COND_INT = Control register bit: defines whether an I2C START condition triggers an interrupt
 // USI_OVERFLOW_INT = Control register bit: defines whether a USI 4-bit counter overflow triggers an interrupt
+// USI_START_VECTOR = Interrupt vector of the USI start condition (TWI_USE_INTERRUPTS builds)
+// USI_OVERFLOW_VECTOR = Interrupt vector of the USI 4-bit counter overflow (TWI_USE_INTERRUPTS builds)
 
 // ATtinyX5
 #if defined(__AVR_ATtiny25__) | \
@@ -43,6 +45,8 @@
 #define TWI_COLLISION_FLAG USIDC
 #define TWI_START_COND_INT USISIE
 #define USI_OVERFLOW_INT USIOIE
+#define USI_START_VECTOR USI_START_vect
+#define USI_OVERFLOW_VECTOR USI_OVF_vect
 #endif
 
 // ATtinyX4
@@ -62,6 +66,8 @@
 #define TWI_COLLISION_FLAG USIDC
 #define TWI_START_COND_INT USISIE
 #define USI_OVERFLOW_INT USIOIE
+#define USI_START_VECTOR USI_STR_vect
+#define USI_OVERFLOW_VECTOR USI_OVF_vect
 #endif
 
 // ATtinyX313
@@ -80,6 +86,8 @@
 #define TWI_COLLISION_FLAG USIDC
 #define TWI_START_COND_INT USISIE
 #define USI_OVERFLOW_INT USIOIE
+#define USI_START_VECTOR USI_START_vect
+#define USI_OVERFLOW_VECTOR USI_OVERFLOW_vect
 #endif
 
 // ATtinyX7
@@ -98,6 +106,8 @@
 #define TWI_COLLISION_FLAG USIDC
 #define TWI_START_COND_INT USISIE
 #define USI_OVERFLOW_INT USIOIE
+#define USI_START_VECTOR USI_START_vect
+#define USI_OVERFLOW_VECTOR USI_OVF_vect
 #endif
 
 // ATtinyX61
@@ -117,6 +127,8 @@
 #define TWI_COLLISION_FLAG USIDC
 #define TWI_START_COND_INT USISIE
 #define USI_OVERFLOW_INT USIOIE
+#define USI_START_VECTOR USI_START_vect
+#define USI_OVERFLOW_VECTOR USI_OVF_vect
 #endif
 
 // ATtiny43
@@ -134,6 +146,8 @@
 #define TWI_COLLISION_FLAG USIDC
 #define TWI_START_COND_INT USISIE
 #define USI_OVERFLOW_INT USIOIE
+#define USI_START_VECTOR USI_START_vect
+#define USI_OVERFLOW_VECTOR USI_OVF_vect
 #endif
 
 #endif  // HARDWARE_MAPPING_H
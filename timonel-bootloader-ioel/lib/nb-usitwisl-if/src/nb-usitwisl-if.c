@@ -4,7 +4,7 @@
  *  .............................................
  *  File: nb-usitwisl-if.c (Slave driver library)
  *  .............................................
- *  Version: 1.0.2 / 2020-09-19
+ *  Version: 1.5.0 / 2026-10-19
  *  gustavo.casanova@nicebots.com
  *  .............................................
  *  Based on work by Atmel (AVR312) et others
@@ -14,14 +14,46 @@
 // Includes
 #include "nb-usitwisl-if.h"
 
+#include <string.h>
+
+// On interrupt-driven builds, the buffer counters are shared with the interrupt handlers
+#if TWI_USE_INTERRUPTS
+#include <util/atomic.h>
+#define TWI_VOLATILE volatile
+#define TWI_ATOMIC ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+#define TWI_VOLATILE
+#define TWI_ATOMIC
+#endif  // TWI_USE_INTERRUPTS
+
+// On inline builds, the driver is compiled only within the application source
+#if (!(TWI_DRIVER_INLINE) || defined(TWI_DRIVER_IMPL))
+
 // USI TWI driver globals
 static uint8_t rx_buffer[TWI_RX_BUFFER_SIZE];
 static uint8_t tx_buffer[TWI_TX_BUFFER_SIZE];
 static uint8_t rx_head = 0, rx_tail = 0;
 static uint8_t tx_head = 0, tx_tail = 0;
-static uint8_t rx_byte_count = 0;  // Bytes received in RX buffer
-static uint8_t tx_byte_count = 0;  // Bytes to transmit in TX buffer
+static TWI_VOLATILE uint8_t rx_byte_count = 0;  // Bytes received in RX buffer
+static TWI_VOLATILE uint8_t tx_byte_count = 0;  // Bytes to transmit in TX buffer
 static OverflowState device_state;
+#ifndef TWI_RECEIVE_EVENT
+void (*p_receive_event)(uint8_t);  // Application receive handler
+#endif  // !TWI_RECEIVE_EVENT
+#if TWI_STOP_DETECT
+void (*p_stop_event)(uint8_t);                  // Application stop handler
+static TWI_VOLATILE bool stop_handled = false;  // The last master write was passed to the stop handler
+#endif  // TWI_STOP_DETECT
+#if TWI_USE_INTERRUPTS
+static volatile bool reply_done = false;  // A master read has been completed
+#endif  // TWI_USE_INTERRUPTS
+#if TWI_REGISTER_MAP
+static uint8_t *p_reg_map = NULL;            // Application registers (NULL: register map mode disabled)
+static const uint8_t *p_reg_protect = NULL;  // Write-protect bit mask, one bit per register (NULL: all writable)
+static uint8_t reg_map_size = 0;             // Registers in the map
+static uint8_t reg_ptr = 0;                  // Register pointer, auto-incremented on each byte
+static bool reg_ptr_pending = false;         // The next byte written by the master sets the pointer
+#endif  // TWI_REGISTER_MAP
 
 // USI TWI driver basic operations prototypes
 void SET_USI_TO_WAIT_FOR_TWI_ADDRESS(void);
@@ -49,11 +81,13 @@ inline static void SET_USI_SDA_AND_SCL_AS_INPUT(void) __attribute__((always_inli
   |___________________________|
 */
 void UsiTwiTransmitByte(const uint8_t data_byte) {
-    while (tx_byte_count == TWI_RX_BUFFER_SIZE) {
+    while (tx_byte_count == TWI_TX_BUFFER_SIZE) {
     };                                               // Wait for a free spot in the buffer
     tx_head = ((tx_head + 1) & TWI_TX_BUFFER_MASK);  // Update the TX buffer head pointer
     tx_buffer[tx_head] = data_byte;                  // Write the data byte into the TX buffer
-    tx_byte_count++;                                 // Update TX buffer used positions counter
+    TWI_ATOMIC {
+        tx_byte_count++;                             // Update TX buffer used positions counter
+    }
 }
 
 /* ___________________________
@@ -65,10 +99,93 @@ uint8_t UsiTwiReceiveByte(void) {
     while (!rx_byte_count) {
     };                                               // Wait until data is present in the RX buffer
     rx_tail = ((rx_tail + 1) & TWI_RX_BUFFER_MASK);  // Update the RX buffer tail pointer
-    rx_byte_count--;                                 // Update RX buffer used positions counter
-    return rx_buffer[rx_tail];                       // Return data from the RX buffer
+    uint8_t data_byte = rx_buffer[rx_tail];          // Read the data before freeing its position
+    TWI_ATOMIC {
+        rx_byte_count--;                             // Update RX buffer used positions counter
+    }
+    return data_byte;                                // Return data from the RX buffer
+}
+
+/* ___________________________
+  |                           |
+  | USI TWI bulk transmission |
+  |___________________________|
+*/
+uint8_t UsiTwiTryWrite(const uint8_t *p_data, const uint8_t length) {
+    // Queue as many bytes as fit in the TX buffer without waiting, return the amount queued
+    uint8_t count = TWI_TX_BUFFER_SIZE - tx_byte_count;
+    if (count > length) {
+        count = length;
+    }
+    uint8_t start = ((tx_head + 1) & TWI_TX_BUFFER_MASK);  // First free position
+    uint8_t run = TWI_TX_BUFFER_SIZE - start;              // Contiguous positions up to the buffer end
+    if (run > count) {
+        run = count;
+    }
+    memcpy(&tx_buffer[start], p_data, run);
+    memcpy(tx_buffer, p_data + run, count - run);          // Wrapped around remainder, if any
+    tx_head = ((tx_head + count) & TWI_TX_BUFFER_MASK);
+    TWI_ATOMIC {
+        tx_byte_count += count;
+    }
+    return count;
 }
 
+/* ___________________________
+  |                           |
+  | USI TWI bulk reception    |
+  |___________________________|
+*/
+uint8_t UsiTwiTryRead(uint8_t *p_data, const uint8_t length) {
+    // Copy as many bytes as available in the RX buffer without waiting, return the amount copied
+    uint8_t count = rx_byte_count;
+    if (count > length) {
+        count = length;
+    }
+    uint8_t start = ((rx_tail + 1) & TWI_RX_BUFFER_MASK);  // Oldest received byte
+    uint8_t run = TWI_RX_BUFFER_SIZE - start;              // Contiguous positions up to the buffer end
+    if (run > count) {
+        run = count;
+    }
+    memcpy(p_data, &rx_buffer[start], run);
+    memcpy(p_data + run, rx_buffer, count - run);          // Wrapped around remainder, if any
+    rx_tail = ((rx_tail + count) & TWI_RX_BUFFER_MASK);
+    TWI_ATOMIC {
+        rx_byte_count -= count;
+    }
+    return count;
+}
+
+/* ___________________________
+  |                           |
+  | USI TWI buffer status     |
+  |___________________________|
+*/
+uint8_t UsiTwiBytesAvailable(void) {
+    return rx_byte_count;  // Bytes received, ready to be read
+}
+
+uint8_t UsiTwiFreeSpace(void) {
+    return TWI_TX_BUFFER_SIZE - tx_byte_count;  // Bytes that can be queued for transmission
+}
+
+#if TWI_REGISTER_MAP
+/* ___________________________
+  |                           |
+  | USI TWI register map      |
+  |___________________________|
+*/
+void UsiTwiSetRegisterMap(uint8_t *p_registers, const uint8_t size, const uint8_t *p_write_protect) {
+    // Serve the master transactions from the application registers, or from the buffers again if NULL
+    TWI_ATOMIC {
+        p_reg_map = (size ? p_registers : NULL);
+        p_reg_protect = p_write_protect;
+        reg_map_size = size;
+        reg_ptr = 0;
+    }
+}
+#endif  // TWI_REGISTER_MAP
+
 /* _______________________________
   |                               |
   | USI TWI driver initialization |
@@ -97,9 +214,17 @@ inline void TwiStartHandler(void) {
     // should check whether it has to reply. Prepare the next overflow handler state for it.
     // Next state -> STATE_CHECK_RECEIVED_ADDRESS
     device_state = STATE_CHECK_RECEIVED_ADDRESS;
+    uint16_t wait_loops = START_WAIT_LOOPS;
     while ((PIN_USI & (1 << PORT_USI_SCL)) && (!(PIN_USI & (1 << PORT_USI_SDA)))) {
         // Wait for SCL to go low to ensure the start condition has completed.
         // The start detector will hold SCL low.
+        if (--wait_loops == 0) {
+            // SCL high and SDA low for too long: a glitch or a stuck bus, not a start condition.
+            // Re-arm the USI to wait for a new start condition and clear all the status flags.
+            SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+            SET_USI_TO_SHIFT_8_ADDRESS_BITS();
+            return;
+        }
     }
     // If a stop condition arises then leave this function to prevent waiting forever.
     // Don't use USISR to test for stop condition as in application note AVR312
@@ -115,6 +240,31 @@ inline void TwiStartHandler(void) {
     SET_USI_TO_SHIFT_8_ADDRESS_BITS();
 }
 
+#if TWI_STOP_DETECT
+/* ______________________________________________________
+  |                                                      |
+  | TWI stop condition handler (polled on all builds)    |
+  |______________________________________________________|
+*/
+bool TwiStopHandler(void) {
+    bool stopped = false;
+    TWI_ATOMIC {
+        // A stop condition while waiting for a data byte ends a master write. The stop flag is
+        // cleared on every USI state change, so it can't be left over from a previous transaction.
+        if (((USISR >> TWI_STOP_COND_FLAG) & true) && (device_state == STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK)) {
+            device_state = STATE_CHECK_RECEIVED_ADDRESS;
+            SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+            stopped = true;
+        }
+    }
+    if (stopped && p_stop_event) {
+        stop_handled = true;
+        p_stop_event(rx_byte_count);  // Process the data written by the master right away
+    }
+    return stopped;
+}
+#endif  // TWI_STOP_DETECT
+
 /* ______________________________________________________
   |                                                      |
   | USI 4-bit overflow handler (Interrupt-like function) |
@@ -128,14 +278,41 @@ inline bool UsiOverflowHandler(void) {
         case STATE_CHECK_RECEIVED_ADDRESS: {
             if ((USIDR == 0) || ((USIDR >> 1) == TWI_ADDR)) {
                 if (USIDR & 0x01) { /* If data register low-order bit = 1, start the send data mode */
+#if TWI_REGISTER_MAP
+                    if (p_reg_map) {
+                        // The registers are sent from the pointer position, the application isn't called
+                        device_state = STATE_SEND_DATA_BYTE;
+                        SET_USI_TO_SEND_ACK();
+                        return false;
+                    }
+#endif  // TWI_REGISTER_MAP
+#if TWI_STOP_DETECT
+                    if (stop_handled) {
+                        // The stop handler already processed the write, only send its reply
+                        stop_handled = false;
+                        device_state = STATE_SEND_DATA_BYTE;
+                        SET_USI_TO_SEND_ACK();
+                        return false;
+                    }
+#endif  // TWI_STOP_DETECT
                     // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+#ifdef TWI_RECEIVE_EVENT
+                    TWI_RECEIVE_EVENT(rx_byte_count);    // Process data in main ...     >>
+#else
                     if (p_receive_event) {               //                             >>
                         p_receive_event(rx_byte_count);  // Process data in main ...     >>
                     }                                    //                             >>
+#endif  // TWI_RECEIVE_EVENT
                     // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
                     // Next state -> STATE_SEND_DATA_BYTE
                     device_state = STATE_SEND_DATA_BYTE;
                 } else { /* If data register low-order bit = 0, start the receive data mode */
+#if TWI_STOP_DETECT
+                    stop_handled = false;  // A new write, its data goes to the receive event unless a stop ends it
+#endif  // TWI_STOP_DETECT
+#if TWI_REGISTER_MAP
+                    reg_ptr_pending = true;  // The first byte written sets the register pointer
+#endif  // TWI_REGISTER_MAP
                     // Next state -> STATE_RECEIVE_DATA_BYTE
                     device_state = STATE_RECEIVE_DATA_BYTE;
                 }
@@ -165,7 +342,19 @@ inline bool UsiOverflowHandler(void) {
         // counter overflows, it means that a byte has been transmitted, so this device is ready
         // to transmit again or wait for a new start condition and address on the bus.
         case STATE_SEND_DATA_BYTE: {
-            if (tx_head != tx_tail) {
+#if TWI_REGISTER_MAP
+            if (p_reg_map) {
+                // Send the register at the pointer position, then point to the next one
+                USIDR = p_reg_map[reg_ptr];
+                if (++reg_ptr == reg_map_size) {
+                    reg_ptr = 0;
+                }
+                device_state = STATE_RECEIVE_ACK_AFTER_SENDING_DATA;
+                SET_USI_TO_SEND_BYTE();
+                return false;
+            }
+#endif  // TWI_REGISTER_MAP
+            if (tx_byte_count) {
                 // If the TX buffer has data, copy the next byte to USI data register for sending
                 tx_tail = ((tx_tail + 1) & TWI_TX_BUFFER_MASK);
                 USIDR = tx_buffer[tx_tail];
@@ -203,10 +392,33 @@ inline bool UsiOverflowHandler(void) {
         // counter overflows, return to the previous state (STATE_RECEIVE_DATA_BYTE).
         // This mode's cycle should end when a stop condition is detected on the bus.
         case STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK: {
-            // Put data into buffer
-            rx_head = ((rx_head + 1) & TWI_RX_BUFFER_MASK);
-            rx_buffer[rx_head] = USIDR;
-            rx_byte_count++;
+#if TWI_REGISTER_MAP
+            if (p_reg_map) {
+                uint8_t data_byte = USIDR;
+                if (reg_ptr_pending) {
+                    // First byte: set the register pointer (out of range values point to the first register)
+                    reg_ptr_pending = false;
+                    reg_ptr = ((data_byte < reg_map_size) ? data_byte : 0);
+                } else {
+                    // Next bytes: write the register unless it's write-protected, then point to the next one
+                    if (!(p_reg_protect && ((p_reg_protect[reg_ptr >> 3] >> (reg_ptr & 0x07)) & true))) {
+                        p_reg_map[reg_ptr] = data_byte;
+                    }
+                    if (++reg_ptr == reg_map_size) {
+                        reg_ptr = 0;
+                    }
+                }
+                device_state = STATE_RECEIVE_DATA_BYTE;
+                SET_USI_TO_SEND_ACK();
+                return false;
+            }
+#endif  // TWI_REGISTER_MAP
+            // Put data into buffer, the byte is dropped if the buffer is full
+            if (rx_byte_count != TWI_RX_BUFFER_SIZE) {
+                rx_head = ((rx_head + 1) & TWI_RX_BUFFER_MASK);
+                rx_buffer[rx_head] = USIDR;
+                rx_byte_count++;
+            }
             // Next state -> STATE_RECEIVE_DATA_BYTE
             device_state = STATE_RECEIVE_DATA_BYTE;
             SET_USI_TO_SEND_ACK();
@@ -219,6 +431,33 @@ inline bool UsiOverflowHandler(void) {
     return false;
 }
 
+#if TWI_USE_INTERRUPTS
+/* _______________________________________________________
+  |                                                       |
+  | USI start condition and counter overflow interrupts   |
+  |_______________________________________________________|
+*/
+ISR(USI_START_VECTOR) {
+    TwiStartHandler();
+}
+
+ISR(USI_OVERFLOW_VECTOR) {
+    if (UsiOverflowHandler()) {
+        reply_done = true;
+    }
+}
+
+// Returns true once after each completed master read (the polled builds get it from UsiOverflowHandler)
+bool UsiTwiReplyDone(void) {
+    bool done = false;
+    TWI_ATOMIC {
+        done = reply_done;
+        reply_done = false;
+    }
+    return done;
+}
+#endif  // TWI_USE_INTERRUPTS
+
 // ----------------------------------------------------------------------------
 // USI TWI basic operations functions
 // ----------------------------------------------------------------------------
@@ -332,3 +571,5 @@ inline void SET_USI_SDA_AND_SCL_AS_OUTPUT(void) {
 inline void SET_USI_SDA_AND_SCL_AS_INPUT(void) {
     DDR_USI &= ~((1 << PORT_USI_SDA) | (1 << PORT_USI_SCL));
 }
+
+#endif  // !TWI_DRIVER_INLINE || TWI_DRIVER_IMPL
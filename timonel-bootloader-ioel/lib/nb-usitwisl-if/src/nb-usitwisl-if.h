@@ -4,7 +4,7 @@
  *  .............................................
  *  File: nb-usitwisl-if.h (Slave driver headers)
  *  .............................................
- *  Version: 1.0.2 / 2020-09-19
+ *  Version: 1.5.0 / 2026-10-19
  *  gustavo.casanova@nicebots.com
  *  .............................................
  *  Based on work by Atmel (AVR312) et others
@@ -22,7 +22,7 @@
 
 // Driver buffer defines
 
-// Allowed RX buffer sizes: 1, 2, 4, 8, 16, 32, 64, 128 or 256
+// Allowed RX buffer sizes: 1, 2, 4, 8, 16, 32, 64 or 128 (byte counts are 8-bit)
 #ifndef TWI_RX_BUFFER_SIZE
 #define TWI_RX_BUFFER_SIZE 64
 #endif  // TWI_RX_BUFFER_SIZE
@@ -33,7 +33,11 @@
 #error TWI RX buffer size is not a power of 2
 #endif  // TWI_RX_BUFFER_SIZE & TWI_RX_BUFFER_MASK
 
-// Allowed TX buffer sizes: 1, 2, 4, 8, 16, 32, 64, 128 or 256
+#if (TWI_RX_BUFFER_SIZE > 128)
+#error TWI RX buffer size is too large, the maximum is 128 bytes
+#endif  // TWI_RX_BUFFER_SIZE > 128
+
+// Allowed TX buffer sizes: 1, 2, 4, 8, 16, 32, 64 or 128 (byte counts are 8-bit)
 #ifndef TWI_TX_BUFFER_SIZE
 #define TWI_TX_BUFFER_SIZE 64
 #endif  // TWI_TX_BUFFER_SIZE
@@ -44,6 +48,23 @@
 #error TWI TX buffer size is not a power of 2
 #endif  // TWI_TX_BUFFER_SIZE & TWI_TX_BUFFER_MASK
 
+#if (TWI_TX_BUFFER_SIZE > 128)
+#error TWI TX buffer size is too large, the maximum is 128 bytes
+#endif  // TWI_TX_BUFFER_SIZE > 128
+
+// Start condition handler timeout:
+// Max time TwiStartHandler() waits for SCL to go low after a start condition. A glitching
+// master or a stuck SDA line can't hold the main loop (or the start condition interrupt,
+// with TWI_USE_INTERRUPTS) for longer than this, the USI is re-armed to wait for a new start.
+#ifndef START_WAIT_US
+#define START_WAIT_US 1000
+#endif  // START_WAIT_US
+
+// Wait loop iterations for START_WAIT_US at F_CPU (about 7 cycles each, at least one)
+#ifndef START_WAIT_LOOPS
+#define START_WAIT_LOOPS ((uint16_t)((((F_CPU / 1000UL) * START_WAIT_US) / 1000UL / 7) + 1))
+#endif  // START_WAIT_LOOPS
+
 // TWI driver operational modes
 typedef enum {
     STATE_CHECK_RECEIVED_ADDRESS = 0,
@@ -54,14 +75,84 @@ typedef enum {
     STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK = 5
 } OverflowState;
 
-// Function pointers
-void (*p_receive_event)(uint8_t);
+// Receive event binding:
+// By default, the driver calls the application's receive handler through the
+// "p_receive_event" function pointer. Defining TWI_RECEIVE_EVENT with the name of
+// the handler (e.g. -D TWI_RECEIVE_EVENT=ReceiveEvent) binds it at compile time and
+// removes the pointer. If TWI_DRIVER_INLINE is also set to true, this file is left
+// empty and the application includes "nb-usitwisl-if.c" in its own source after
+// declaring the handler, so that the compiler is able to inline it.
+#ifndef TWI_DRIVER_INLINE
+#define TWI_DRIVER_INLINE false
+#endif  // TWI_DRIVER_INLINE
+
+#if (TWI_DRIVER_INLINE && !defined(TWI_RECEIVE_EVENT))
+#error TWI_DRIVER_INLINE requires setting TWI_RECEIVE_EVENT to the receive handler name
+#endif  // TWI_DRIVER_INLINE && !TWI_RECEIVE_EVENT
+
+#ifdef TWI_RECEIVE_EVENT
+#if !(TWI_DRIVER_INLINE)
+void TWI_RECEIVE_EVENT(const uint8_t received_bytes);
+#endif  // !TWI_DRIVER_INLINE
+#else
+// Function pointers (defined in the driver source)
+extern void (*p_receive_event)(uint8_t);
+#endif  // TWI_RECEIVE_EVENT
+
+// Interrupt-driven build:
+// By default, the driver is interrupt-free and the application main loop polls the USI
+// status register to call TwiStartHandler() and UsiOverflowHandler(). Setting
+// TWI_USE_INTERRUPTS to true runs both handlers from the USI start condition and counter
+// overflow interrupt vectors instead, so the bus response time doesn't depend on the main
+// loop. The application must enable the interrupts (sei) after UsiTwiDriverInit() and must
+// not call the handlers itself. Completed master reads are reported by UsiTwiReplyDone().
+#ifndef TWI_USE_INTERRUPTS
+#define TWI_USE_INTERRUPTS false
+#endif  // TWI_USE_INTERRUPTS
+
+// Register map mode:
+// Setting TWI_REGISTER_MAP to true adds UsiTwiSetRegisterMap(), which makes the driver serve
+// "write register N" and "read register N" transactions straight from an application RAM array.
+// The first byte of each master write sets the register pointer, the next ones are written to
+// the registers not protected in the write-protect bit mask. Master reads return the registers
+// starting at the pointer. The pointer auto-increments and wraps around at the end of the map.
+// Neither the buffers nor the receive event are used while a register map is set.
+#ifndef TWI_REGISTER_MAP
+#define TWI_REGISTER_MAP false
+#endif  // TWI_REGISTER_MAP
+
+// Stop condition detection:
+// The USI has no stop condition interrupt, so the data written by the master is normally
+// handled only when the next read address arrives. Setting TWI_STOP_DETECT to true adds
+// TwiStopHandler(), to be called from the main loop on both polled and interrupt-driven
+// builds. When a master write has ended with a stop condition, it re-arms the USI, calls
+// the "p_stop_event" handler (if set) with the bytes received, and returns true.
+#ifndef TWI_STOP_DETECT
+#define TWI_STOP_DETECT false
+#endif  // TWI_STOP_DETECT
+
+#if TWI_STOP_DETECT
+extern void (*p_stop_event)(uint8_t);
+#endif  // TWI_STOP_DETECT
 
 // USI TWI driver prototypes
 void UsiTwiTransmitByte(const uint8_t data_byte);
 uint8_t UsiTwiReceiveByte(void);
+uint8_t UsiTwiTryWrite(const uint8_t *p_data, const uint8_t length);
+uint8_t UsiTwiTryRead(uint8_t *p_data, const uint8_t length);
+uint8_t UsiTwiBytesAvailable(void);
+uint8_t UsiTwiFreeSpace(void);
 void UsiTwiDriverInit(void);
 void TwiStartHandler(void);
 bool UsiOverflowHandler(void);
+#if TWI_USE_INTERRUPTS
+bool UsiTwiReplyDone(void);
+#endif  // TWI_USE_INTERRUPTS
+#if TWI_STOP_DETECT
+bool TwiStopHandler(void);
+#endif  // TWI_STOP_DETECT
+#if TWI_REGISTER_MAP
+void UsiTwiSetRegisterMap(uint8_t *p_registers, const uint8_t size, const uint8_t *p_write_protect);
+#endif  // TWI_REGISTER_MAP
 
 #endif  // NB_USITWISL_IF_H
@@ -49,6 +49,10 @@
 #error "If the AUTO_PAGE_ADDR option is disabled, then CMD_SETPGADDR must be enabled in tml-config.h!"
 #endif
 
+#if (!(TWI_HW_DRIVER) && TWI_USE_INTERRUPTS)
+#error "The interrupt vectors belong to the application, please build the TWI driver with TWI_USE_INTERRUPTS disabled"
+#endif
+
 #if ((MST_PACKET_SIZE > (TWI_RX_BUFFER_SIZE / 2)) || ((SLV_PACKET_SIZE > (TWI_TX_BUFFER_SIZE / 2))))
 #pragma GCC warning "Don't set transmission data size too high to avoid affecting the TWI reliability!"
 #endif
@@ -96,6 +100,16 @@ inline static void Reply_WRITEEPR(const uint8_t *command) __attribute__((always_
 inline static void Reply_READEEPR(const uint8_t *command) __attribute__((always_inline));
 #endif  // EEPROM_ACCESS
 
+#if TWI_DRIVER_INLINE
+// TWI driver compiled within the bootloader source: ReceiveEvent is bound and inlined at compile time
+#define TWI_DRIVER_IMPL
+#if TWI_HW_DRIVER
+#include <nb-twihwsl-if.c>
+#else
+#include <nb-usitwisl-if.c>
+#endif  // TWI_HW_DRIVER
+#endif  // TWI_DRIVER_INLINE
+
 // Main function
 int main(void) {
     /* ___________________
@@ -163,7 +177,9 @@ int main(void) {
 #endif                                                                             // LOW_FUSE PRESCALER BIT
 #endif                                                                             // AUTO_CLK_TWEAK
     UsiTwiDriverInit();                                                            // Initialize the TWI driver
+#ifndef TWI_RECEIVE_EVENT
     p_receive_event = ReceiveEvent;                                                // Pointer to TWI receive event function
+#endif                                                                             // !TWI_RECEIVE_EVENT
     __SPM_REG = (_BV(CTPB) | _BV(__SPM_ENABLE));                                   // Prepare to clear the temporary page buffer
     asm volatile("spm");                                                           // Run SPM instruction to complete the clearing
     static const fptr_t RunApplication = (const fptr_t)((TIMONEL_START - 2) / 2);  // Pointer to trampoline to app address
@@ -187,6 +203,17 @@ int main(void) {
       |___________________|
     */
     for (;;) {
+#if TWI_HW_DRIVER
+        /*......................................................
+          . TWI PERIPHERAL INTERRUPT EMULATION                   .
+          . The TWI hardware matches the address and holds SCL   .
+          . low after each event until its flag is cleared      .
+          ......................................................
+        */
+        if (TWI_EVENT_PENDING()) {
+            slow_ops_enabled = TwiEventHandler();
+        }
+#else
         /*......................................................
           . USI TWI INTERRUPT EMULATION [ START ]               .
           . Check the USI status register to verify whether      .
@@ -208,6 +235,7 @@ int main(void) {
             //slow_ops_enabled = UsiOverflowHandler(p_mem_pack);
             slow_ops_enabled = UsiOverflowHandler();
         }
+#endif  // TWI_HW_DRIVER
         /*..............................
           :                             .
           :   Bootloader initialized     .
@@ -16,8 +16,9 @@ MCU = attiny85
 # - How many pages in is that? 6068 / 64 (tiny85 page size in bytes) = 94.8125
 # - round that down to 94 - our new bootloader address is 94 * 64 = 6016, in hex = 1780
 # NOTE: If it doesn't compile, comment the below [# TIMONEL_START = XXXX ] line to
+# "auto": two-pass build that places the bootloader at the highest page where it fits
 
-TIMONEL_START = 19C0
+TIMONEL_START = auto
 
 # Timonel TWI address (decimal value):
 # -------------------------------------
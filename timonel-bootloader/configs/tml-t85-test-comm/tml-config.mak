@@ -6,7 +6,8 @@
 # .......................................................
 
 # Microcontroller: ATtiny 85 - 1 MHz
-# Configuration:   Test Comm: All features enabled, except APP_USE_TPL_PG and TWO_STEP_INIT
+# Configuration:   Test Comm: All features enabled, except APP_USE_TPL_PG and TWO_STEP_INIT,
+#                  plus the ECHOTEST, SINKTEST and SRCETEST bus self-test commands
 
 MCU = attiny85
 
@@ -16,8 +17,9 @@ MCU = attiny85
 # - How many pages in is that? 6068 / 64 (tiny85 page size in bytes) = 94.8125
 # - round that down to 94 - our new bootloader address is 94 * 64 = 6016, in hex = 1780
 # NOTE: If it doesn't compile, comment the below [# TIMONEL_START = XXXX ] line to
+# "auto": two-pass build that places the bootloader at the highest page where it fits
 
-TIMONEL_START = 19C0
+TIMONEL_START = auto
 
 # Timonel TWI address (decimal value):
 # -------------------------------------
@@ -39,6 +41,7 @@ APP_AUTORUN    = true
 CMD_READFLASH  = true
 CMD_READDEVS   = true
 EEPROM_ACCESS  = true
+CMD_BUSTEST    = true
 # Warning: Please modify the below options with caution ...
 AUTO_CLK_TWEAK = false
 LOW_FUSE       = 0x62
@@ -29,6 +29,7 @@ CFG_DFT="tml-t85-std"
 TML_CFG="tml-config.mak";
 HEX_SFX=".hex";
 MAK_OPT="";
+SIZE_START="1000";  # Low start address used to measure the bootloader size without overflowing
 
 ARG1=${1:-$CFG_DFT};
 ARG2=$2;    # ARG2=${2:-timonel};
@@ -51,6 +52,7 @@ print_help() {
     echo "  FW_NAME     Name of the .hex binary file to produce. (Def=timonel)";
     echo "  TWI_ADDR    TWI (I2C) address to assign to the device. Range: 8-35 (Def=11).";
     echo "  START_ADDR  Bootloader start address in the device memory. Range: 0-1C00.";
+    echo "              \"auto\" places it at the highest page that fits its size.";
     echo "  CLK_SPEED   Device speed settings (in MHz). Values: 1, 2, 8 or 16 (Def=1).";
     echo "  AUTO_TWEAK  Defines if the device speed adjustments will be made at";
     echo "              run time. Valid options: false-true (Def=false).";    
@@ -58,6 +60,7 @@ print_help() {
     echo "Options:";
     echo "  -h --help   Prints this help.";
     echo "  -a --all    Generates all Timonel configurations.";    
+    echo "  -s --sizes  Prints the bootloader size and pages used by each configuration.";
     echo "";
     echo "Examples:";
     echo "";
@@ -76,6 +79,11 @@ print_help() {
     echo "  assigning TWI address 17 to the device, setting 0x1B00 device memory position";
     echo "  as bootloader start, setting the device low fuse to operate at 8 MHz";
     echo "  and disabling automatic clock tweaking.";
+    echo "";
+    echo "  $ $0 tml-t85-full timonel 11 auto";
+    echo "";
+    echo "  Generates a \"timonel.hex\" binary file based on \"tml-t85-full\" config,";
+    echo "  with the bootloader start address calculated from its actual size.";
 }
 
 case ${ARG1} in
@@ -98,6 +106,34 @@ case ${ARG1} in
         done
         exit;
         ;;
+    -s|-sizes|--s|--sizes)
+        echo "";
+        echo "| Configuration | TIMONEL_START | Size (bytes) | Pages | Minimum start | Slack (bytes) |";
+        echo "|---|---|---|---|---|---|";
+        for TML_CFG in `ls -l ${CFG_DIR} | awk '{print $9}'`; do
+            # Flash and page sizes of the configuration MCU, taken from avr-libc as the Makefile does
+            TML_MCU=`awk '/^MCU/ {print $3}' ${CFG_DIR}/${TML_CFG}/tml-config.mak`;
+            FLASH_SIZE=$(( `echo FLASHEND | avr-gcc -mmcu=${TML_MCU} -E -P -x c -include avr/io.h - | tail -n 1` + 1 ));
+            PAGE_SIZE=`echo SPM_PAGESIZE | avr-gcc -mmcu=${TML_MCU} -E -P -x c -include avr/io.h - | tail -n 1`;
+            make clean_all CONFIG=${TML_CFG} TARGET=${TML_CFG} > /dev/null 2>&1;
+            make all CONFIG=${TML_CFG} TARGET=${TML_CFG} TIMONEL_START=${SIZE_START} > /dev/null 2>&1;
+            # Bootloader size = .text + .data, the same as the "data" size of the .hex file
+            TML_SIZE=`avr-size ${TML_CFG}.bin | awk 'NR==2 {print $1 + $2}'`;
+            TML_PAGES=$(( (TML_SIZE + PAGE_SIZE - 1) / PAGE_SIZE ));
+            MIN_START=$(( FLASH_SIZE - (TML_PAGES * PAGE_SIZE) ));
+            CFG_START=`awk '/^TIMONEL_START/ {print $3}' ${CFG_DIR}/${TML_CFG}/tml-config.mak`;
+            if [ "${CFG_START}" = "auto" ]; then
+                CFG_ADDR=${MIN_START};  # Auto start: placed at the minimum start address
+            else
+                CFG_ADDR=$(( 0x${CFG_START} ));
+                CFG_START="0x${CFG_START}";
+            fi
+            printf "| %s | %s | %d | %d | 0x%X | %d |\n" ${TML_CFG} ${CFG_START} ${TML_SIZE} ${TML_PAGES} ${MIN_START} \
+                $(( FLASH_SIZE - CFG_ADDR - TML_SIZE ));
+            make clean_all CONFIG=${TML_CFG} TARGET=${TML_CFG} > /dev/null 2>&1;
+        done
+        exit;
+        ;;
     *)
         if [ ! -f "./${CFG_DIR}/${ARG1}/${TML_CFG}" ]; then
             echo "";
@@ -0,0 +1,113 @@
+/*
+ *  Timonel - TWI Bootloader for ATtiny MCUs
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: timonel-twi-api.h (Resident TWI driver API)
+ *  ...........................................
+ *  Version: 1.6 "Sandra" / 2023-04-28
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+/* This file is shared by the bootloader and the applications that use its
+   resident TWI slave driver (TWI_APP_API option). Applications only need to
+   include it, there is no library to link: the driver entry points are called
+   through a jump table placed at a fixed address below FLASHEND. They are the
+   same functions the bootloader runs on (timonel-usi.c), there is one copy.
+
+   Jump table layout (TWI_API_ADDR):
+     +0: TWI_API_MAGIC       +1: TWI_API_VERSION
+     +2: rjmp UsiTwiDriverInit
+     +4: rjmp UsiTwiTransmitByte
+     +6: rjmp UsiTwiReceiveByte
+     +8: rjmp UsiTwiPoll
+     Unused slots up to TWI_API_SIZE are left erased (0xFF) for later versions.
+
+   The bootloader doesn't keep any driver state in RAM for the application,
+   everything lives in a UsiTwiContext allocated by the application. */
+
+#ifndef _TIMONEL_TWI_API_H_
+#define _TIMONEL_TWI_API_H_
+
+#include <avr/io.h>
+
+#define TWI_API_MAGIC 0x54                           /* 'T': a driver table is present */
+#define TWI_API_VERSION 2                            /* Table and context layout version */
+#define TWI_API_SIZE 16                              /* Bytes reserved for the table at the top of the flash */
+#define TWI_API_ADDR (FLASHEND + 1 - TWI_API_SIZE)   /* Table start address */
+
+// Jump table slot offsets (bytes from TWI_API_ADDR)
+#define TWI_API_INIT 2
+#define TWI_API_TRANSMIT 4
+#define TWI_API_RECEIVE 6
+#define TWI_API_POLL 8
+
+// Driver events, returned by UsiTwiPoll()
+#define TWI_EV_NONE 0            /* Nothing to report */
+#define TWI_EV_START 1           /* Start condition */
+#define TWI_EV_START_TMOUT 2     /* Start condition timeout: the USI was re-armed */
+#define TWI_EV_ADDR_MISMATCH 3   /* Address of another device */
+#define TWI_EV_WRITE 4           /* Own address, master write: the received bytes follow */
+#define TWI_EV_READ 5            /* Own address, master read: queue the reply before the next poll */
+#define TWI_EV_RX_BYTE 6         /* Byte received */
+#define TWI_EV_TX_BYTE 7         /* Byte transmitted */
+#define TWI_EV_REPLY_DONE 8      /* Master read complete */
+
+#ifndef __ASSEMBLER__
+
+#include <avr/pgmspace.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Driver context (TWI_API_VERSION 2 layout). The caller sets the address, the buffers and
+// their masks before UsiTwiDriverInit(). The buffer sizes must be powers of 2, up to 256
+// bytes, and each buffer holds up to its mask bytes.
+typedef struct usi_twi_context {
+    uint8_t twi_addr;                          // 7-bit TWI address to answer to
+    uint8_t rx_mask, tx_mask;                  // RX and TX buffer sizes - 1
+    uint8_t *rx_buffer;                        // Bytes written by the master
+    uint8_t *tx_buffer;                        // Bytes to be read by the master
+    uint8_t device_state;                      // USI overflow handler state
+    uint8_t rx_head, rx_tail, rx_byte_count;   // RX ring buffer indexes and bytes available
+    uint8_t tx_head, tx_tail, tx_byte_count;   // TX ring buffer indexes and bytes queued
+} UsiTwiContext;
+
+#ifndef TWI_API_IMPL  // The bootloader defines TWI_API_IMPL and implements the below functions
+
+// Entry points (word addresses, as used by the AVR function pointers)
+#define TWI_API_ENTRY(slot) ((TWI_API_ADDR + (slot)) / 2)
+
+// Returns true if the bootloader provides a driver table with at least the required version
+static inline bool UsiTwiApiAvailable(const uint8_t version) {
+    return ((pgm_read_byte(TWI_API_ADDR) == TWI_API_MAGIC) &&
+            (pgm_read_byte(TWI_API_ADDR + 1) != 0xFF) &&
+            (pgm_read_byte(TWI_API_ADDR + 1) >= version));
+}
+
+// Flushes the context buffers and sets the USI in TWI slave mode
+static inline void UsiTwiDriverInit(UsiTwiContext *p_ctx) {
+    ((void (*)(UsiTwiContext *))TWI_API_ENTRY(TWI_API_INIT))(p_ctx);
+}
+
+// Queues a byte for the master to read. Returns false, without waiting, if the TX buffer is full
+static inline bool UsiTwiTransmitByte(UsiTwiContext *p_ctx, const uint8_t data_byte) {
+    return ((bool (*)(UsiTwiContext *, uint8_t))TWI_API_ENTRY(TWI_API_TRANSMIT))(p_ctx, data_byte);
+}
+
+// Returns the next byte written by the master. Check "rx_byte_count" first, it returns 0 if there are none
+static inline uint8_t UsiTwiReceiveByte(UsiTwiContext *p_ctx) {
+    return ((uint8_t(*)(UsiTwiContext *))TWI_API_ENTRY(TWI_API_RECEIVE))(p_ctx);
+}
+
+// Runs the USI start and overflow handlers when their flags are set and returns the last driver
+// event (TWI_EV_*). Call it from the main loop as often as possible. On TWI_EV_READ, the USI holds
+// SCL low until the next call: queue the reply to the bytes received before calling it again.
+static inline uint8_t UsiTwiPoll(UsiTwiContext *p_ctx) {
+    return ((uint8_t(*)(UsiTwiContext *))TWI_API_ENTRY(TWI_API_POLL))(p_ctx);
+}
+
+#endif /* TWI_API_IMPL */
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* _TIMONEL_TWI_API_H_ */
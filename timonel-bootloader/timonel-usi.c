@@ -0,0 +1,251 @@
+/*
+ *  Timonel - TWI Bootloader for ATtiny MCUs
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: timonel-usi.c (USI TWI slave driver)
+ *  ...........................................
+ *  Version: 1.6 "Sandra" / 2023-04-28
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+/* The bootloader TWI slave driver. All its state is kept in a UsiTwiContext, so the same
+   code serves the bootloader and, with TWI_APP_API, the applications that call it through
+   the jump table in crt1.S. The handlers don't know about the bootloader commands, stats or
+   trace: they return driver events (TWI_EV_*) and the caller acts on them.
+
+   TWI_APP_API = false: timonel.c includes this file after defining TWI_DRIVER_IMPL, the
+   handlers are inlined in the main loop. Built on its own, this translation unit is empty.
+
+   TWI_APP_API = true: this file is built in its own translation unit and the bootloader calls
+   the exported functions too. The Makefile compiles it without the "-mno-interrupts" and
+   "-mtiny-stack" options used for the bootloader: within the application, interrupts may be
+   enabled and the stack may be above 256 bytes, so the stack frames (if any) have to be set
+   up the standard way. */
+
+// Includes
+#include <stdbool.h>
+
+#if (TWI_APP_API || defined(TWI_DRIVER_IMPL))
+
+#include "timonel-usi.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////////////         USI TWI DRIVER CODE BELOW THIS LINE         ////////////
+/////////////////////////////////////////////////////////////////////////////
+
+/* _______________________________
+  |                               |
+  | USI TWI driver initialization |
+  |_______________________________|
+*/
+void UsiTwiDriverInit(UsiTwiContext *p_ctx) {
+    // Initialize USI for TWI Slave mode.
+    p_ctx->rx_head = p_ctx->rx_tail = p_ctx->rx_byte_count = 0;  // Flush TWI RX buffer
+    p_ctx->tx_head = p_ctx->tx_tail = p_ctx->tx_byte_count = 0;  // Flush TWI TX buffer
+    p_ctx->device_state = STATE_CHECK_RECEIVED_ADDRESS;
+    SET_USI_SDA_AND_SCL_AS_OUTPUT();        // Set SCL and SDA as output
+    PORT_USI |= (1 << PORT_USI_SDA);        // Set SDA high
+    PORT_USI |= (1 << PORT_USI_SCL);        // Set SCL high
+    SET_USI_SDA_AS_INPUT();                 // Set SDA as input
+    SET_USI_TO_WAIT_FOR_TWI_ADDRESS();      // Wait for TWI start condition and address from master
+}
+
+/* ___________________________
+  |                           |
+  | USI TWI byte transmission |
+  |___________________________|
+*/
+bool UsiTwiTransmitByte(UsiTwiContext *p_ctx, const uint8_t data_byte) {
+    if (p_ctx->tx_byte_count == p_ctx->tx_mask) {
+        return false;  // The TX buffer is full, don't wait: only the overflow handler drains it
+    }
+    p_ctx->tx_buffer[p_ctx->tx_head] = data_byte;                // Write the data byte into the TX buffer
+    p_ctx->tx_head = ((p_ctx->tx_head + 1) & p_ctx->tx_mask);    // Update the TX buffer index
+    p_ctx->tx_byte_count++;
+    return true;
+}
+
+#if TWI_APP_API
+/* ________________________
+  |                        |
+  | USI TWI byte reception |
+  |________________________|
+*/
+uint8_t UsiTwiReceiveByte(UsiTwiContext *p_ctx) {
+    if (p_ctx->rx_byte_count == 0) {
+        return 0;  // The RX buffer is empty, don't wait: only the overflow handler fills it
+    }
+    uint8_t data_byte = p_ctx->rx_buffer[p_ctx->rx_tail];
+    p_ctx->rx_tail = ((p_ctx->rx_tail + 1) & p_ctx->rx_mask);
+    p_ctx->rx_byte_count--;
+    return data_byte;
+}
+#endif // TWI_APP_API
+
+/* _______________________________________________________
+  |                                                       |
+  | TWI start condition handler (Interrupt-like function) |
+  |_______________________________________________________|
+*/
+uint8_t UsiTwiStartHandler(UsiTwiContext *p_ctx) {
+    SET_USI_SDA_AS_INPUT();  // Float the SDA line
+    // Following a start condition, the device shifts the address present on the TWI bus in and
+    // a 4-bit counter overflow is triggered. Afterward, within the overflow handler, the device
+    // should check whether it has to reply. Prepare the next overflow handler state for it.
+    // Next state -> STATE_CHECK_RECEIVED_ADDRESS
+    p_ctx->device_state = STATE_CHECK_RECEIVED_ADDRESS;
+    uint16_t wait_loops = START_WAIT_LOOPS;
+    while ((PIN_USI & (1 << PORT_USI_SCL)) && (!(PIN_USI & (1 << PORT_USI_SDA)))) {
+        // Wait for SCL to go low to ensure the start condition has completed.
+        // The start detector will hold SCL low.
+        if (--wait_loops == 0) {
+            // SCL high and SDA low for too long: a glitch or a stuck bus, not a start condition.
+            // Re-arm the USI to wait for a new start condition and clear all the status flags.
+            SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+            SET_USI_TO_SHIFT_8_ADDRESS_BITS();
+            return TWI_EV_START_TMOUT;
+        }
+    }
+    // If a stop condition arises then leave this function to prevent waiting forever.
+    // Don't use USISR to test for stop condition as in application note AVR312
+    // because the stop condition flag is going to be set from the last TWI sequence.
+    if (!(PIN_USI & (1 << PIN_USI_SDA))) {
+        // ==> Stop condition NOT DETECTED
+        SET_USI_TO_DETECT_TWI_RESTART();
+    } else {
+        // ==> Stop condition DETECTED
+        SET_USI_TO_DETECT_TWI_START();
+    }
+    // Read the address present on the TWI bus
+    SET_USI_TO_SHIFT_8_ADDRESS_BITS();
+    return TWI_EV_START;
+}
+
+/* ______________________________________________________
+  |                                                      |
+  | USI 4-bit overflow handler (Interrupt-like function) |
+  |______________________________________________________|
+*/
+uint8_t UsiTwiOverflowHandler(UsiTwiContext *p_ctx) {
+    switch (p_ctx->device_state) {
+        // If the address received after the start condition matches this device or is
+        // a general call, reply ACK and check whether it should send or receive data.
+        // Otherwise, set USI to wait for the next start condition and address.
+        case STATE_CHECK_RECEIVED_ADDRESS: {
+            uint8_t twi_address = USIDR;    // Read the USI data register only once
+            if ((twi_address == 0) || ((twi_address >> 1) == p_ctx->twi_addr)) {
+                SET_USI_TO_SEND_ACK();
+                if (twi_address & 0x01) {  // If data register low-order bit = 1, start the send data mode
+                    // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+                    // Address bit 0 is = 1: the caller processes the received bytes and    >>
+                    // queues the reply now. After the ACK bit, the USI holds SCL low until  >>
+                    // the next overflow handler call, which sends the first reply byte.     >>
+                    // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+                    // Next state -> STATE_SEND_DATA_BYTE
+                    p_ctx->device_state = STATE_SEND_DATA_BYTE;
+                    return TWI_EV_READ;
+                }
+                // If data register low-order bit = 0, start the receive data mode
+                // Next state -> STATE_RECEIVE_DATA_BYTE
+                p_ctx->device_state = STATE_RECEIVE_DATA_BYTE;
+                return TWI_EV_WRITE;
+            }
+            SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+            return TWI_EV_ADDR_MISMATCH;
+        }
+        // Send data mode:
+        //================
+        // 3) Check whether the acknowledge bit received from the master is ACK or
+        // NACK. If ACK (low), just continue to STATE_SEND_DATA_BYTE without break. If NACK (high)
+        // the transmission is complete. Wait for a new start condition and TWI address.
+        case STATE_CHECK_RECEIVED_ACK: {
+            if (USIDR) {  // NACK - handshake complete ...
+                SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+                return TWI_EV_REPLY_DONE;
+            }
+            // Just drop straight into STATE_SEND_DATA_BYTE (no break) ...
+        }
+        // 1) Copy data from TX buffer to USIDR and set USI to shift 8 bits out. When the 4-bit
+        // counter overflows, it means that a byte has been transmitted, so this device is ready
+        // to transmit again or wait for a new start condition and address on the bus.
+        case STATE_SEND_DATA_BYTE: {
+            if (p_ctx->tx_byte_count == 0) {
+                // If the TX buffer is empty ...
+                SET_USI_TO_RECEIVE_ACK();  // This might be necessary (http://www.avrfreaks.net/index.php?name=PNphpBB2&file=viewtopic&p=805227#805227)
+                SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+                return TWI_EV_NONE;
+            }
+            // If the TX buffer has data, copy the next byte to USI data register for sending
+            USIDR = p_ctx->tx_buffer[p_ctx->tx_tail];
+            p_ctx->tx_tail = ((p_ctx->tx_tail + 1) & p_ctx->tx_mask);
+            p_ctx->tx_byte_count--;
+            // Next state -> STATE_RECEIVE_ACK_AFTER_SENDING_DATA
+            p_ctx->device_state = STATE_RECEIVE_ACK_AFTER_SENDING_DATA;
+            SET_USI_TO_SEND_BYTE();
+            return TWI_EV_TX_BYTE;
+        }
+        // 2) Set USI to receive an acknowledge bit reply from master
+        case STATE_RECEIVE_ACK_AFTER_SENDING_DATA: {
+            // Next state -> STATE_CHECK_RECEIVED_ACK
+            p_ctx->device_state = STATE_CHECK_RECEIVED_ACK;
+            SET_USI_TO_RECEIVE_ACK();
+            return TWI_EV_NONE;
+        }
+        // Receive data mode:
+        // ==================
+        // 1) Set the USI to shift 8 bits in. When the 4-bit counter overflows,
+        // it means that a byte has been received and this device should process it
+        // on the next overflow state (STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK).
+        case STATE_RECEIVE_DATA_BYTE: {
+            // Next state -> STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK
+            p_ctx->device_state = STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK;
+            SET_USI_TO_RECEIVE_BYTE();
+            return TWI_EV_NONE;
+        }
+        // 2) Copy the received byte from USIDR to RX buffer and send ACK. After the
+        // counter overflows, return to the previous state (STATE_RECEIVE_DATA_BYTE).
+        // This mode's cycle should end when a stop condition is detected on the bus.
+        case STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK: {
+            if (p_ctx->rx_byte_count == p_ctx->rx_mask) {
+                // Frame longer than the RX buffer: NACK this byte, drop the frame and wait for a new start condition
+                p_ctx->rx_head = p_ctx->rx_tail = p_ctx->rx_byte_count = 0;
+                SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+                return TWI_EV_NONE;
+            }
+            // Put data into buffer
+            p_ctx->rx_buffer[p_ctx->rx_head] = USIDR;
+            p_ctx->rx_head = ((p_ctx->rx_head + 1) & p_ctx->rx_mask);
+            p_ctx->rx_byte_count++;
+            // Next state -> STATE_RECEIVE_DATA_BYTE
+            p_ctx->device_state = STATE_RECEIVE_DATA_BYTE;
+            SET_USI_TO_SEND_ACK();
+            return TWI_EV_RX_BYTE;
+        }
+    }
+    // Clear the 4-bit counter overflow flag in USI status register after processing each
+    // overflow state to allow detecting new interrupts that take this device to next states.
+    USISR |= (1 << USI_OVERFLOW_FLAG);
+    return TWI_EV_NONE;
+}
+
+#if TWI_APP_API
+/* ______________________________________________
+  |                                              |
+  | USI TWI start and overflow handlers polling  |
+  |______________________________________________|
+*/
+uint8_t UsiTwiPoll(UsiTwiContext *p_ctx) {
+    // Same checks as the bootloader main loop, for applications
+    uint8_t twi_event = TWI_EV_NONE;
+    if (((USISR >> TWI_START_COND_FLAG) & true) && ((USICR >> TWI_START_COND_INT) & true)) {
+        twi_event = UsiTwiStartHandler(p_ctx);
+    }
+    if (((USISR >> USI_OVERFLOW_FLAG) & true) && ((USICR >> USI_OVERFLOW_INT) & true)) {
+        twi_event = UsiTwiOverflowHandler(p_ctx);
+    }
+    return twi_event;
+}
+#endif // TWI_APP_API
+
+#endif // TWI_APP_API || TWI_DRIVER_IMPL
@@ -0,0 +1,321 @@
+/*
+ *  Timonel - TWI Bootloader for ATtiny MCUs
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: timonel-usi.h (USI TWI driver basics)
+ *  ...........................................
+ *  Version: 1.6 "Sandra" / 2023-04-28
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+/* USI hardware mapping, overflow handler states, basic USI operations and the driver
+   prototypes. The driver (timonel-usi.c) is inlined in the bootloader, or built in its
+   own translation unit and exported to applications when TWI_APP_API is enabled. */
+
+#ifndef _TIMONEL_USI_H_
+#define _TIMONEL_USI_H_
+
+#include <avr/io.h>
+
+#define TWI_API_IMPL  // Driver context and events only, the functions are implemented in timonel-usi.c
+#include "timonel-twi-api.h"
+
+// Start condition handler timeout
+// Max time waiting for SCL to go low after a start condition. A glitching master or a stuck SDA line
+// can't hold the main loop for longer than this, the USI is re-armed to wait for a new start.
+#ifndef START_WAIT_US
+#define START_WAIT_US 1000
+#endif /* START_WAIT_US */
+
+// Wait loop iterations for START_WAIT_US at F_CPU (about 7 cycles each, at least one)
+#ifndef START_WAIT_LOOPS
+#define START_WAIT_LOOPS ((uint16_t)((((F_CPU / 1000UL) * START_WAIT_US) / 1000UL / 7) + 1))
+#endif /* START_WAIT_LOOPS */
+
+// USI TWI driver operational modes
+typedef enum {
+    STATE_CHECK_RECEIVED_ADDRESS = 0,
+    STATE_SEND_DATA_BYTE = 1,
+    STATE_RECEIVE_ACK_AFTER_SENDING_DATA = 2,
+    STATE_CHECK_RECEIVED_ACK = 3,
+    STATE_RECEIVE_DATA_BYTE = 4,
+    STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK = 5
+} OverflowState;
+
+// USI TWI driver prototypes
+#if TWI_APP_API
+void UsiTwiDriverInit(UsiTwiContext *p_ctx);
+bool UsiTwiTransmitByte(UsiTwiContext *p_ctx, const uint8_t data_byte);
+uint8_t UsiTwiReceiveByte(UsiTwiContext *p_ctx);
+uint8_t UsiTwiStartHandler(UsiTwiContext *p_ctx) __attribute__((noinline));
+uint8_t UsiTwiOverflowHandler(UsiTwiContext *p_ctx) __attribute__((noinline));
+uint8_t UsiTwiPoll(UsiTwiContext *p_ctx);
+#else
+inline static void UsiTwiDriverInit(UsiTwiContext *p_ctx) __attribute__((always_inline));
+static bool UsiTwiTransmitByte(UsiTwiContext *p_ctx, const uint8_t data_byte);
+inline static uint8_t UsiTwiStartHandler(UsiTwiContext *p_ctx) __attribute__((always_inline));
+inline static uint8_t UsiTwiOverflowHandler(UsiTwiContext *p_ctx) __attribute__((always_inline));
+#endif /* TWI_APP_API */
+
+// USI TWI hardware mapping
+// ------------------------
+// DDR_USI = I2C data direction register
+// PORT_USI = I2C output register
+// PIN_USI = I2C input register
+// PORT_USI_SDA = I2C SDA output register
+// PORT_USI_SCL = I2C SCL output register
+// PIN_USI_SDA = I2C SDA input register
+// PIN_USI_SCL = I2C SDL input register
+// TWI_START_COND_FLAG = Status register flag: indicates an I2C START condition on the bus (can trigger an interrupt)
+// USI_OVERFLOW_FLAG = Status register flag: indicates a complete bit reception/transmission (can trigger an interrupt)
+// TWI_STOP_COND_FLAG = Status register flag: indicates an I2C STOP condition on the bus
+// TWI_COLLISION_FLAG = Status register flag: indicates a data output collision on the bus
+// TWI_START_COND_INT = Control register bit: defines whether an I2C START condition triggers an interrupt
+// USI_OVERFLOW_INT = Control register bit: defines whether a USI 4-bit counter overflow triggers an interrupt
+
+// ATtinyX5
+#if defined(__AVR_ATtiny25__) | \
+    defined(__AVR_ATtiny45__) | \
+    defined(__AVR_ATtiny85__)
+#define DDR_USI DDRB
+#define PORT_USI PORTB
+#define PIN_USI PINB
+#define PORT_USI_SDA PB0
+#define PORT_USI_SCL PB2
+#define PIN_USI_SDA PINB0
+#define PIN_USI_SCL PINB2
+#define TWI_START_COND_FLAG USISIF
+#define USI_OVERFLOW_FLAG USIOIF
+#define TWI_STOP_COND_FLAG USIPF
+#define TWI_COLLISION_FLAG USIDC
+#define TWI_START_COND_INT USISIE
+#define USI_OVERFLOW_INT USIOIE
+#endif // ATtinyX5
+
+// ATtinyX4
+#if defined(__AVR_ATtiny24__) | \
+    defined(__AVR_ATtiny44__) | \
+    defined(__AVR_ATtiny84__)
+#define DDR_USI DDRA
+#define PORT_USI PORTA
+#define PIN_USI PINA
+#define PORT_USI_SDA PORTA6
+#define PORT_USI_SCL PORTA4
+#define PIN_USI_SDA PINA6
+#define PIN_USI_SCL PINA4
+#define TWI_START_COND_FLAG USISIF
+#define USI_OVERFLOW_FLAG USIOIF
+#define TWI_STOP_COND_FLAG USIPF
+#define TWI_COLLISION_FLAG USIDC
+#define TWI_START_COND_INT USISIE
+#define USI_OVERFLOW_INT USIOIE
+#endif
+
+// ATtinyX313
+#if defined(__AVR_ATtiny2313__) | \
+    defined(__AVR_ATtiny4313__)
+#define DDR_USI DDRB
+#define PORT_USI PORTB
+#define PIN_USI PINB
+#define PORT_USI_SDA PB5
+#define PORT_USI_SCL PB7
+#define PIN_USI_SDA PINB5
+#define PIN_USI_SCL PINB7
+#define TWI_START_COND_FLAG USISIF
+#define USI_OVERFLOW_FLAG USIOIF
+#define TWI_STOP_COND_FLAG USIPF
+#define TWI_COLLISION_FLAG USIDC
+#define TWI_START_COND_INT USISIE
+#define USI_OVERFLOW_INT USIOIE
+#endif
+
+// ATtinyX7
+#if defined(__AVR_ATtiny87__) | \
+    defined(__AVR_ATtiny167__)
+#define DDR_USI DDRB
+#define PORT_USI PORTB
+#define PIN_USI PINB
+#define PORT_USI_SDA PB0
+#define PORT_USI_SCL PB2
+#define PIN_USI_SDA PINB0
+#define PIN_USI_SCL PINB2
+#define TWI_START_COND_FLAG USISIF
+#define USI_OVERFLOW_FLAG USIOIF
+#define TWI_STOP_COND_FLAG USIPF
+#define TWI_COLLISION_FLAG USIDC
+#define TWI_START_COND_INT USISIE
+#define USI_OVERFLOW_INT USIOIE
+#endif
+
+// ATtinyX61
+#if defined(__AVR_ATtiny261__) | \
+    defined(__AVR_ATtiny461__) | \
+    defined(__AVR_ATtiny861__)
+#define DDR_USI DDRB
+#define PORT_USI PORTB
+#define PIN_USI PINB
+#define PORT_USI_SDA PB0
+#define PORT_USI_SCL PB2
+#define PIN_USI_SDA PINB0
+#define PIN_USI_SCL PINB2
+#define TWI_START_COND_FLAG USISIF
+#define USI_OVERFLOW_FLAG USIOIF
+#define TWI_STOP_COND_FLAG USIPF
+#define TWI_COLLISION_FLAG USIDC
+#define TWI_START_COND_INT USISIE
+#define USI_OVERFLOW_INT USIOIE
+#endif
+
+// ATtiny43
+#if defined(__AVR_ATtiny43U__)
+#define DDR_USI DDRB
+#define PORT_USI PORTB
+#define PIN_USI PINB
+#define PORT_USI_SDA PORTB4
+#define PORT_USI_SCL PORTB6
+#define PIN_USI_SDA PINB4
+#define PIN_USI_SCL PINB6
+#define TWI_START_COND_FLAG USISIF
+#define USI_OVERFLOW_FLAG USIOIF
+#define TWI_STOP_COND_FLAG USIPF
+#define TWI_COLLISION_FLAG USIDC
+#define TWI_START_COND_INT USISIE
+#define USI_OVERFLOW_INT USIOIE
+#endif
+
+// USI TWI driver basic operations prototypes
+inline static void SET_USI_TO_WAIT_FOR_TWI_ADDRESS(void) __attribute__((always_inline));
+inline static void SET_USI_TO_SEND_BYTE(void) __attribute__((always_inline));
+inline static void SET_USI_TO_RECEIVE_BYTE(void) __attribute__((always_inline));
+inline static void SET_USI_TO_SEND_ACK(void) __attribute__((always_inline));
+inline static void SET_USI_TO_RECEIVE_ACK(void) __attribute__((always_inline));
+inline static void SET_USI_TO_DETECT_TWI_START(void) __attribute__((always_inline));
+inline static void SET_USI_TO_DETECT_TWI_RESTART(void) __attribute__((always_inline));
+inline static void SET_USI_TO_SHIFT_8_ADDRESS_BITS(void) __attribute__((always_inline));
+inline static void SET_USI_TO_SHIFT_8_DATA_BITS(void) __attribute__((always_inline));
+inline static void SET_USI_TO_SHIFT_1_ACK_BIT(void) __attribute__((always_inline));
+
+// USI TWI driver direction setting prototypes
+inline static void SET_USI_SDA_AS_OUTPUT(void) __attribute__((always_inline));
+inline static void SET_USI_SDA_AS_INPUT(void) __attribute__((always_inline));
+inline static void SET_USI_SCL_AS_OUTPUT(void) __attribute__((always_inline));
+inline static void SET_USI_SCL_AS_INPUT(void) __attribute__((always_inline));
+inline static void SET_USI_SDA_AND_SCL_AS_OUTPUT(void) __attribute__((always_inline));
+inline static void SET_USI_SDA_AND_SCL_AS_INPUT(void) __attribute__((always_inline));
+
+// ----------------------------------------------------------------------------
+// USI TWI basic operations functions
+// ----------------------------------------------------------------------------
+// Set USI to detect start and shift 7 address bits + 1 direction bit in.
+inline void SET_USI_TO_WAIT_FOR_TWI_ADDRESS(void) {
+    SET_USI_TO_DETECT_TWI_START();   // Detect start condition
+    SET_USI_TO_SHIFT_8_DATA_BITS();  // Shift 8 bits
+}
+// ............................................................................
+// Set USI to send a byte.
+inline void SET_USI_TO_SEND_BYTE(void) {
+    SET_USI_SDA_AS_OUTPUT();         // Drive the SDA line
+    SET_USI_TO_SHIFT_8_DATA_BITS();  // Shift 8 bits
+}
+// ............................................................................
+// Set USI to receive a byte.
+inline void SET_USI_TO_RECEIVE_BYTE(void) {
+    SET_USI_SDA_AS_INPUT();          // Float the SDA line
+    SET_USI_TO_SHIFT_8_DATA_BITS();  // Shift 8 bits
+}
+// ............................................................................
+// Set USI to send an ACK bit.
+inline void SET_USI_TO_SEND_ACK(void) {
+    USIDR = 0;                     // Clear the USI data register
+    SET_USI_SDA_AS_OUTPUT();       // Drive the SDA line
+    SET_USI_TO_SHIFT_1_ACK_BIT();  // Shift 1 bit
+}
+// ............................................................................
+// Set USI to receive an ACK bit.
+inline void SET_USI_TO_RECEIVE_ACK(void) {
+    USIDR = 0;                     // Clear the USI data register
+    SET_USI_SDA_AS_INPUT();        // Float the SDA line
+    SET_USI_TO_SHIFT_1_ACK_BIT();  // Shift 1 bit
+}
+
+// ----------------------------------------------------------------------------
+// USI register configurations
+// ----------------------------------------------------------------------------
+// Configure USI control register to detect start condition.
+inline void SET_USI_TO_DETECT_TWI_START(void) {
+    USICR = (1 << TWI_START_COND_INT) | (0 << USI_OVERFLOW_INT) |  // Enable start condition interrupt, disable overflow interrupt
+            (1 << USIWM1) | (0 << USIWM0) |                        // Set USI in Two-wire mode, don't hold SCL low when the 4-bit counter overflows
+            (1 << USICS1) | (0 << USICS0) | (0 << USICLK) |        // Clock Source = External (positive edge) for data register, External (both edges) for 4-Bit counter
+            (0 << USITC);                                          // No toggle clock-port pin (SCL)
+}
+// ............................................................................
+// Configure USI control register to detect RESTART.
+inline void SET_USI_TO_DETECT_TWI_RESTART(void) {
+    USICR = (1 << TWI_START_COND_INT) | (1 << USI_OVERFLOW_INT) |  // Enable start condition interrupt, disable overflow interrupt
+            (1 << USIWM1) | (1 << USIWM0) |                        // Set USI in Two-wire mode, hold SCL low when the 4-bit counter overflows
+            (1 << USICS1) | (0 << USICS0) | (0 << USICLK) |        // Clock Source = External (positive edge) for data register, External (both edges) for 4-Bit counter
+            (0 << USITC);                                          // No toggle clock-port pin (SCL)
+}
+// ............................................................................
+// Clear all USI status register interrupt flags to prepare for new start conditions.
+inline void SET_USI_TO_SHIFT_8_ADDRESS_BITS(void) {
+    USISR = (1 << TWI_START_COND_FLAG) |
+            (1 << USI_OVERFLOW_FLAG) |
+            (1 << TWI_STOP_COND_FLAG) |
+            (1 << TWI_COLLISION_FLAG) |
+            (0x0 << USICNT0);  // Reset status register 4-bit counter to shift 8 bits (data byte to be received)
+}
+// ............................................................................
+// Clear all USI status register interrupt flags, except start condition.
+inline void SET_USI_TO_SHIFT_8_DATA_BITS(void) {
+    USISR = (0 << TWI_START_COND_FLAG) |
+            (1 << USI_OVERFLOW_FLAG) |
+            (1 << TWI_STOP_COND_FLAG) |
+            (1 << TWI_COLLISION_FLAG) |
+            (0x0 << USICNT0);  // Set status register 4-bit counter to shift 8 bits
+}
+// ............................................................................
+// Clear all USI status register interrupt flags, except start condition.
+inline void SET_USI_TO_SHIFT_1_ACK_BIT(void) {
+    USISR = (0 << TWI_START_COND_FLAG) |
+            (1 << USI_OVERFLOW_FLAG) |
+            (1 << TWI_STOP_COND_FLAG) |
+            (1 << TWI_COLLISION_FLAG) |
+            (0x0E << USICNT0);  // Set status register 4-bit counter to shift 1 bit
+}
+
+// ----------------------------------------------------------------------------
+// GPIO TWI direction settings
+// ----------------------------------------------------------------------------
+// Drive the data line
+inline void SET_USI_SDA_AS_OUTPUT(void) {
+    DDR_USI |= (1 << PORT_USI_SDA);
+}
+// ............................................................................
+// Float the data line
+inline void SET_USI_SDA_AS_INPUT(void) {
+    DDR_USI &= ~(1 << PORT_USI_SDA);
+}
+// ............................................................................
+// Drive the clock line
+inline void SET_USI_SCL_AS_OUTPUT(void) {
+    DDR_USI |= (1 << PORT_USI_SCL);
+}
+// ............................................................................
+// Float the clock line
+inline void SET_USI_SCL_AS_INPUT(void) {
+    DDR_USI &= ~(1 << PORT_USI_SCL);
+}
+// ............................................................................
+// Drive the data and clock lines
+inline void SET_USI_SDA_AND_SCL_AS_OUTPUT(void) {
+    DDR_USI |= (1 << PORT_USI_SDA) | (1 << PORT_USI_SCL);
+}
+// ............................................................................
+// Float the data and clock lines
+inline void SET_USI_SDA_AND_SCL_AS_INPUT(void) {
+    DDR_USI &= ~((1 << PORT_USI_SDA) | (1 << PORT_USI_SCL));
+}
+
+#endif /* _TIMONEL_USI_H_ */
@@ -53,15 +53,40 @@
 #pragma GCC warning "The commands packets size should be half the size of the I2C buffers!"
 #endif
 
-#if ((MST_PACKET_SIZE > 64) || (SLV_PACKET_SIZE > 64))
+#if ((MST_PACKET_SIZE > SPM_PAGESIZE) || (SPM_PAGESIZE % MST_PACKET_SIZE != 0))
+#error "MST_PACKET_SIZE must be a divisor of the device's SPM_PAGESIZE, a WRITPAGE frame can't span two pages!"
+#endif
+
+#if ((MST_PACKET_SIZE + 2 + WRITPAGE_VARLEN) > TWI_RX_BUFFER_MASK)
+#error "TWI_RX_BUFFER_SIZE is too small to hold a whole WRITPAGE frame, please increase it!"
+#endif
+
+#if (SLV_PACKET_SIZE > 64)
 #pragma GCC warning "Commands packet sizes greater than 64 bytes could affect the handshake reliability!"
 #endif
 
+#if (DEFER_TPL_COMMIT && !(AUTO_PAGE_ADDR))
+#error "DEFER_TPL_COMMIT needs AUTO_PAGE_ADDR, otherwise the trampoline is written by the TWI master!"
+#endif
+
+#if (UPLOAD_JOURNAL && (E2END < 64))
+#error "UPLOAD_JOURNAL needs a device with at least 64 bytes of EEPROM!"
+#endif
+
+#if (VERIFY_IMAGE && (!(AUTO_PAGE_ADDR) || CMD_SETPGADDR))
+#error "VERIFY_IMAGE needs AUTO_PAGE_ADDR without CMD_SETPGADDR, the application must be uploaded in order from page 0!"
+#endif
+
+#if (VERIFY_IMAGE && (E2END < 64))
+#error "VERIFY_IMAGE needs a device with at least 64 bytes of EEPROM!"
+#endif
+
 #if ((CYCLESTOEXIT > 0) && (CYCLESTOEXIT < 10))
 #pragma GCC warning "Do not set CYCLESTOEXIT too low, it could make difficult for TWI master to initialize on time!"
 #endif
 
 // Bootloader prototypes
+int main(void) __attribute__((OS_main));    // Entered from crt1.S and never returns: no register saving needed
 inline static void ReceiveEvent(const uint8_t *command, MemPack *p_mem_pack) __attribute__((always_inline));
 inline static void ResetPrescaler(void) __attribute__((always_inline));
 inline static void RestorePrescaler(void) __attribute__((always_inline));
@@ -72,6 +97,12 @@ inline static void Reply_DELFLASH(MemPack *p_mem_pack) __attribute__((always_inl
 inline static void Reply_STPGADDR(const uint8_t *command, MemPack *p_mem_pack) __attribute__((always_inline));
 #endif // CMD_SETPGADDR || !AUTO_PAGE_ADDR
 inline static void Reply_WRITPAGE(const uint8_t *command, MemPack *p_mem_pack) __attribute__((always_inline));
+#if AUTO_PAGE_ADDR
+inline static uint16_t CalculateTrampoline(MemPack *p_mem_pack) __attribute__((always_inline));
+#endif // AUTO_PAGE_ADDR
+#if (DEFER_TPL_COMMIT && APP_USE_TPL_PG)
+static uint16_t TrampolineWord(const uint16_t app_word, MemPack *p_mem_pack);
+#endif // DEFER_TPL_COMMIT && APP_USE_TPL_PG
 #if CMD_READFLASH
 inline static void Reply_READFLSH(const uint8_t *command) __attribute__((always_inline));
 #endif // CMD_READFLASH
@@ -79,37 +110,56 @@ inline static void Reply_INITSOFT(MemPack *p_mem_pack) __attribute__((always_inl
 #if CMD_READDEVS
 inline static void Reply_READDEVS(void) __attribute__((always_inline));
 #endif // CMD_READDEVS
+#if CMD_GETCAPAB
+inline static void Reply_GETCAPAB(void) __attribute__((always_inline));
+#endif // CMD_GETCAPAB
+#if BATCH_WRITES
+inline static void Reply_GETBATCH(MemPack *p_mem_pack) __attribute__((always_inline));
+#endif // BATCH_WRITES
 #if EEPROM_ACCESS
 inline static void Reply_WRITEEPR(const uint8_t *command) __attribute__((always_inline));
 inline static void Reply_READEEPR(const uint8_t *command) __attribute__((always_inline));
 #endif // EEPROM_ACCESS
+#if UPLOAD_JOURNAL
+inline static void Reply_GETRESUM(const uint8_t *command, MemPack *p_mem_pack) __attribute__((always_inline));
+inline static void UpdateJournal(const uint16_t next_page, MemPack *p_mem_pack) __attribute__((always_inline));
+#endif // UPLOAD_JOURNAL
+#if VERIFY_IMAGE
+static bool ValidateImage(MemPack *p_mem_pack);
+static uint16_t CalculateImageCrc(void);
+#endif // VERIFY_IMAGE
+#if CMD_PATCHPAGE
+inline static void Reply_PATCHPAG(const uint8_t *command, MemPack *p_mem_pack) __attribute__((always_inline));
+#endif // CMD_PATCHPAGE
+#if CMD_ERASERANGE
+inline static void Reply_ERASERNG(const uint8_t *command, MemPack *p_mem_pack) __attribute__((always_inline));
+#endif // CMD_ERASERANGE
+#if ENABLE_STATS
+inline static void Reply_GETSTATS(const uint8_t *command) __attribute__((always_inline));
+#endif // ENABLE_STATS
+#if USE_TICK_TIMER
+static uint16_t GetTicks(void);
+#endif // USE_TICK_TIMER
+#if ENABLE_TRACE
+inline static void Reply_GETTRACE(void) __attribute__((always_inline));
+static void TraceEvent(const uint8_t event, const uint8_t arg);
+#endif // ENABLE_TRACE
+#if CMD_BUSTEST
+inline static void Reply_ECHOTEST(const uint8_t *command) __attribute__((always_inline));
+inline static void Reply_SINKTEST(const uint8_t *command) __attribute__((always_inline));
+inline static void Reply_SRCETEST(const uint8_t *command) __attribute__((always_inline));
+static void TransmitBusTestCount(BusTestCount *p_count);
+#endif // CMD_BUSTEST
+static void TransmitReply(const uint8_t *reply, const uint8_t reply_len);
 
-// USI TWI driver prototypes
-void UsiTwiTransmitByte(const uint8_t data_byte);
-uint8_t UsiTwiReceiveByte(void);
-inline static void UsiTwiDriverInit(void) __attribute__((always_inline));
-inline static void TwiStartHandler(void) __attribute__((always_inline));
-inline static bool UsiOverflowHandler(MemPack *p_mem_pack) __attribute__((always_inline));
-
-// USI TWI driver basic operations prototypes
-inline static void SET_USI_TO_WAIT_FOR_TWI_ADDRESS(void) __attribute__((always_inline));
-inline static void SET_USI_TO_SEND_BYTE(void) __attribute__((always_inline));
-inline static void SET_USI_TO_RECEIVE_BYTE(void) __attribute__((always_inline));
-inline static void SET_USI_TO_SEND_ACK(void) __attribute__((always_inline));
-inline static void SET_USI_TO_RECEIVE_ACK(void) __attribute__((always_inline));
-inline static void SET_USI_TO_DETECT_TWI_START(void) __attribute__((always_inline));
-inline static void SET_USI_TO_DETECT_TWI_RESTART(void) __attribute__((always_inline));
-inline static void SET_USI_TO_SHIFT_8_ADDRESS_BITS(void) __attribute__((always_inline));
-inline static void SET_USI_TO_SHIFT_8_DATA_BITS(void) __attribute__((always_inline));
-inline static void SET_USI_TO_SHIFT_1_ACK_BIT(void) __attribute__((always_inline));
-
-// USI TWI driver direction setting prototypes
-inline static void SET_USI_SDA_AS_OUTPUT(void) __attribute__((always_inline));
-inline static void SET_USI_SDA_AS_INPUT(void) __attribute__((always_inline));
-inline static void SET_USI_SCL_AS_OUTPUT(void) __attribute__((always_inline));
-inline static void SET_USI_SCL_AS_INPUT(void) __attribute__((always_inline));
-inline static void SET_USI_SDA_AND_SCL_AS_OUTPUT(void) __attribute__((always_inline));
-inline static void SET_USI_SDA_AND_SCL_AS_INPUT(void) __attribute__((always_inline));
+// USI TWI driver event prototypes (the driver prototypes are in "timonel-usi.h")
+inline static void ProcessCommand(MemPack *p_mem_pack) __attribute__((always_inline));
+#if (ENABLE_STATS || ENABLE_TRACE)
+inline static void LogTwiEvent(const uint8_t twi_event) __attribute__((always_inline));
+#endif // ENABLE_STATS || ENABLE_TRACE
+#if USI_STOP_DETECT
+inline static bool UsiStopHandler(MemPack *p_mem_pack) __attribute__((always_inline));
+#endif // USI_STOP_DETECT
 
 // Main function
 int main(void) {
@@ -138,6 +188,9 @@ int main(void) {
 #if ENABLE_LED_UI
     LED_UI_DDR |= (1 << LED_UI_PIN);        // Set led pin data direction register for output
 #endif // ENABLE_LED_UI
+#if ENABLE_PROBES
+    PROBE_DDR |= ((1 << PROBE_TWI_PIN) | (1 << PROBE_OVF_PIN) | (1 << PROBE_SPM_PIN));   // Set probe pins for output
+#endif // ENABLE_PROBES
 #if APP_AUTORUN
     uint8_t exit_delay = SHORT_EXIT_DLY;    // Exit-to-app delay when the bootloader isn't initialized
 #endif // APP_AUTORUN
@@ -177,7 +230,25 @@ int main(void) {
     ResetPrescaler();                                                               // Reset prescaler to divide by 1
 #endif                                                                              // LOW_FUSE PRESCALER BIT
 #endif                                                                              // AUTO_CLK_TWEAK
-    UsiTwiDriverInit();                                                             // Initialize the TWI driver
+    twi_ctx.twi_addr = TWI_ADDR;                                                    // Set the TWI driver address and buffers
+    twi_ctx.rx_buffer = rx_buffer;
+    twi_ctx.rx_mask = TWI_RX_BUFFER_MASK;
+    twi_ctx.tx_buffer = tx_buffer;
+    twi_ctx.tx_mask = TWI_TX_BUFFER_MASK;
+    UsiTwiDriverInit(&twi_ctx);                                                     // Initialize the TWI driver
+#if USE_TICK_TIMER
+    TICK_TIMER_CTL = TICK_TIMER_CLK_SEL;                                            // Start the tick timer
+#endif // USE_TICK_TIMER
+#if USI_IDLE_SLEEP
+#if USE_TICK_TIMER
+    TICK_TIMER_IMSK |= (1 << TOIE0);                                                // Tick timer overflows wake the CPU up too
+#endif // USE_TICK_TIMER
+    set_sleep_mode(SLEEP_MODE_IDLE);                                                // Idle mode: the USI keeps running
+    sleep_enable();
+#endif // USI_IDLE_SLEEP
+#if ENABLE_STATS
+    uint16_t loop_start = 0;                                                        // Main loop iteration start tick
+#endif // ENABLE_STATS
     __SPM_REG = (_BV(CTPB) | _BV(__SPM_ENABLE));                                    // Prepare to clear the temporary page buffer
     asm volatile("spm");                                                            // Run SPM instruction to complete the clearing
     static const fptr_t RunApplication = (const fptr_t)((TIMONEL_START - 2) / 2);   // Pointer to trampoline to app address
@@ -194,12 +265,59 @@ int main(void) {
     p_mem_pack->app_reset_lsb = 0x00;
     p_mem_pack->app_reset_msb = 0x00;
 #endif // AUTO_PAGE_ADDR
+#if UPLOAD_JOURNAL
+    p_mem_pack->image_id = JOURNAL_NO_IMAGE;
+#endif // UPLOAD_JOURNAL
+#if (UPLOAD_JOURNAL || VERIFY_IMAGE)
+    p_mem_pack->upload_crc = 0;
+#endif // UPLOAD_JOURNAL || VERIFY_IMAGE
+#if VERIFY_PAGE
+    p_mem_pack->page_sum = 0;
+#endif // VERIFY_PAGE
+#if CMD_PATCHPAGE
+    p_mem_pack->patch_page = 0x0000;
+#endif // CMD_PATCHPAGE
+#if CMD_ERASERANGE
+    p_mem_pack->erase_page = 0x0000;
+    p_mem_pack->erase_count = 0;
+#endif // CMD_ERASERANGE
+#if DEFER_TPL_COMMIT
+    p_mem_pack->tpl_commit = false;
+#endif // DEFER_TPL_COMMIT
+#if BATCH_WRITES
+    p_mem_pack->batch_frames = 0;
+    p_mem_pack->batch_sum = 0;
+    p_mem_pack->batch_status = 0;
+#endif // BATCH_WRITES
     /* ___________________
       |                   | 
       |     Main Loop     |
       |___________________|
     */
     for (;;) {
+#if ENABLE_STATS
+        // Longest main loop iteration
+        uint16_t loop_ticks = GetTicks();
+        if ((uint16_t)(loop_ticks - loop_start) > stats.max_loop_ticks) {
+            stats.max_loop_ticks = (loop_ticks - loop_start);
+        }
+        loop_start = loop_ticks;
+#elif ENABLE_TRACE
+        GetTicks();  // Keep the tick timer MSB up to date
+#endif  // ENABLE_STATS
+#if USI_STOP_DETECT
+        /*......................................................
+          . USI TWI STOP CONDITION DETECTION                    .
+          . A stop condition while receiving data ends a master  .
+          . write: process the command right away               .
+          ......................................................
+        */
+        if (((USISR >> TWI_STOP_COND_FLAG) & true) && (twi_ctx.device_state == STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK)) {
+            PROBE_ON(PROBE_TWI_PIN);
+            slow_ops_enabled = UsiStopHandler(p_mem_pack);
+            PROBE_OFF(PROBE_TWI_PIN);
+        }
+#endif  // USI_STOP_DETECT
         /*......................................................
           . USI TWI INTERRUPT EMULATION [ START ]               .
           . Check the USI status register to verify whether      .
@@ -208,7 +326,13 @@ int main(void) {
         */
         if (((USISR >> TWI_START_COND_FLAG) & true) && ((USICR >> TWI_START_COND_INT) & true)) {
             // If so, run the USI start handler ...
-            TwiStartHandler();
+            PROBE_ON(PROBE_TWI_PIN);
+#if (ENABLE_STATS || ENABLE_TRACE)
+            LogTwiEvent(UsiTwiStartHandler(&twi_ctx));
+#else
+            UsiTwiStartHandler(&twi_ctx);
+#endif // ENABLE_STATS || ENABLE_TRACE
+            PROBE_OFF(PROBE_TWI_PIN);
         }
         /*......................................................
           . USI TWI INTERRUPT EMULATION [ OVERFLOW ]            .
@@ -218,7 +342,34 @@ int main(void) {
         */
         if (((USISR >> USI_OVERFLOW_FLAG) & true) && ((USICR >> USI_OVERFLOW_INT) & true)) {
             // If so, run the USI overflow handler ...
-            slow_ops_enabled = UsiOverflowHandler(p_mem_pack);
+            PROBE_ON(PROBE_OVF_PIN);
+            uint8_t twi_event = UsiTwiOverflowHandler(&twi_ctx);
+            PROBE_OFF(PROBE_OVF_PIN);
+#if (ENABLE_STATS || ENABLE_TRACE)
+            LogTwiEvent(twi_event);
+#endif // ENABLE_STATS || ENABLE_TRACE
+            // Enable slow operations in main when a master read is complete
+            slow_ops_enabled = (twi_event == TWI_EV_REPLY_DONE);
+            if (twi_event == TWI_EV_READ) {
+                // The master reads the reply: process the received command and queue the reply
+                // while the USI holds SCL low, before the overflow handler sends its first byte.
+#if USI_STOP_DETECT
+                if (twi_ctx.rx_byte_count != 0) {  // Not processed yet by the stop handler (repeated start)
+                    ProcessCommand(p_mem_pack);
+                }
+#else
+                ProcessCommand(p_mem_pack);
+#endif  // USI_STOP_DETECT
+            }
+#if BATCH_WRITES
+            else if ((twi_event == TWI_EV_WRITE) && (twi_ctx.rx_byte_count != 0) && (rx_buffer[0] == WRTBATCH)) {
+                // The previous transaction wrote a batched frame, nobody reads its reply: process
+                // it now, then run the slow operations (e.g. a page write) before this one is received.
+                // SCL is held low by the USI until the next overflow handler call, the bus stalls meanwhile.
+                ProcessCommand(p_mem_pack);
+                slow_ops_enabled = true;
+            }
+#endif  // BATCH_WRITES
         }
         /*..............................
           :                             .
@@ -239,10 +390,43 @@ int main(void) {
             */
             if (slow_ops_enabled == true) {
                 slow_ops_enabled = false;
+                TRACE_EVENT(TR_SLOW_OPS, p_mem_pack->flags);
+#if DEFER_TPL_COMMIT
+                // =============================================================
+                // = Write the trampoline at the end of the upload (Slow-Op 0) =
+                // =============================================================
+                if (((p_mem_pack->flags >> FL_EXIT_TML) & true) && (p_mem_pack->tpl_commit == true)) {
+                    p_mem_pack->tpl_commit = false;
+                    // Keep the current trampoline page contents, only its last word changes
+                    const __flash uint16_t *tpl_position = (void *)(TIMONEL_START - SPM_PAGESIZE);
+                    for (uint8_t i = 0; i < SPM_PAGESIZE - 2; i += 2) {
+                        boot_page_fill((TIMONEL_START - SPM_PAGESIZE) + i, *(tpl_position++));
+                    }
+#if APP_USE_TPL_PG
+                    if (*tpl_position != 0xFFFF) {
+                        // If the application overwrites the trampoline bytes, delete it instead of exiting!
+                        boot_temp_buff_erase();
+                        p_mem_pack->flags &= ~(1 << FL_EXIT_TML);
+                        p_mem_pack->flags |= (1 << FL_DEL_FLASH);
+                    } else
+#endif // APP_USE_TPL_PG
+                    {
+                        boot_page_fill((TIMONEL_START - 2), CalculateTrampoline(p_mem_pack));
+                        PROBE_ON(PROBE_SPM_PIN);
+                        boot_page_write(TIMONEL_START - SPM_PAGESIZE);
+                        PROBE_OFF(PROBE_SPM_PIN);
+                        STATS_COUNT(page_writes);
+                    }
+                }
+#endif // DEFER_TPL_COMMIT
                 // =========================================================
                 // = Exit the bootloader & run the application (Slow-Op 1) =
                 // =========================================================
+#if VERIFY_IMAGE
+                if (((p_mem_pack->flags >> FL_EXIT_TML) & true) && (ValidateImage(p_mem_pack) == true)) {
+#else
                 if ((p_mem_pack->flags >> FL_EXIT_TML) & true) {
+#endif // VERIFY_IMAGE
 #if CLEAR_BIT_7_R31
                     asm volatile("cbr r31, 0x80");  // Clear bit 7 of r31
 #endif                                              // CLEAR_BIT_7_R31
@@ -261,6 +445,19 @@ int main(void) {
                     RestorePrescaler();             // Restore prescaler factor to divide by 8
 #endif // PRESCALER BIT
 #endif // AUTO_CLK_TWEAK
+#if USE_TICK_TIMER
+                    TICK_TIMER_CTL = 0;             // Stop the tick timer
+#endif // USE_TICK_TIMER
+#if USI_IDLE_SLEEP
+#if USE_TICK_TIMER
+                    TICK_TIMER_IMSK &= ~(1 << TOIE0);
+#endif // USE_TICK_TIMER
+                    sleep_disable();                // Leave the sleep settings as they were at reset
+#endif // USI_IDLE_SLEEP
+#if ENABLE_PROBES
+                    PROBE_PORT &= ~((1 << PROBE_TWI_PIN) | (1 << PROBE_OVF_PIN) | (1 << PROBE_SPM_PIN));  // Release the probe pins
+                    PROBE_DDR &= ~((1 << PROBE_TWI_PIN) | (1 << PROBE_OVF_PIN) | (1 << PROBE_SPM_PIN));   // to the application
+#endif // ENABLE_PROBES
                     RunApplication();               // Exit to the application
                 }
                 // ==================================================
@@ -270,11 +467,23 @@ int main(void) {
 #if ENABLE_LED_UI
                     LED_UI_PORT |= (1 << LED_UI_PIN);   // Turn led on to indicate erasing ...
 #endif // ENABLE_LED_UI
+#if VERIFY_IMAGE
+                    eeprom_update_byte(&((ImageRecord *)IMAGE_EEPROM_ADDR)->state, IMG_NONE);
+                    eeprom_busy_wait();                 // SPM is ignored while the EEPROM write runs
+#endif // VERIFY_IMAGE
                     uint16_t page_to_del = TIMONEL_START;
                     while (page_to_del != RESET_PAGE) {
                         page_to_del -= SPM_PAGESIZE;
+                        PROBE_ON(PROBE_SPM_PIN);
                         boot_page_erase(page_to_del);   // Erase flash memory ...
+                        PROBE_OFF(PROBE_SPM_PIN);
+                        STATS_COUNT(page_erases);
+                        TICK_UPDATE();
                     }
+#if UPLOAD_JOURNAL
+                    p_mem_pack->upload_crc = 0;
+                    UpdateJournal(RESET_PAGE, p_mem_pack);  // Nothing left to resume, keep the image ID
+#endif // UPLOAD_JOURNAL
 #if AUTO_CLK_TWEAK
                     if ((boot_lock_fuse_bits_get(GET_LOW_FUSE_BITS) & 0x0F) == RCOSC_CLK_SRC) {
                         OSCCAL = factory_osccal;        // Back the oscillator calibration to its original setting
@@ -303,18 +512,47 @@ int main(void) {
 #if ENABLE_LED_UI
                     LED_UI_PORT ^= (1 << LED_UI_PIN);   // Turn led on and off to indicate writing ...
 #endif // ENABLE_LED_UI
+                    PROBE_ON(PROBE_SPM_PIN);
 #if FORCE_ERASE_PG
                     boot_page_erase(p_mem_pack->page_addr);
+                    STATS_COUNT(page_erases);
 #endif // FORCE_ERASE_PG
                     boot_page_write(p_mem_pack->page_addr);
-#if AUTO_PAGE_ADDR
-                    uint16_t tpl = (((~((TIMONEL_START >> 1) - ((((p_mem_pack->app_reset_msb << 8) | p_mem_pack->app_reset_lsb) + 1) & 0x0FFF)) + 1) & 0x0FFF) | 0xC000);
+                    PROBE_OFF(PROBE_SPM_PIN);
+                    STATS_COUNT(page_writes);
+#if VERIFY_PAGE
+                    // Read the page back and compare it with the data filled into the buffer
+                    const __flash uint16_t *page_position = (void *)p_mem_pack->page_addr;
+                    uint16_t flash_sum = 0;
+                    for (uint8_t i = 0; i < (SPM_PAGESIZE / 2); i++) {
+                        flash_sum += *(page_position++);
+                    }
+                    if (flash_sum != p_mem_pack->page_sum) {
+                        p_mem_pack->flags |= (1 << FL_PAGE_ERR);    // Report it in the next reply
+                    }
+                    p_mem_pack->page_sum = 0;
+#endif // VERIFY_PAGE
+#if (AUTO_PAGE_ADDR && DEFER_TPL_COMMIT)
+                    if (p_mem_pack->page_addr == RESET_PAGE) {
+                        p_mem_pack->tpl_commit = true;  // The trampoline is written on exit
+                    }
+#if APP_USE_TPL_PG
+                    if (p_mem_pack->page_addr == (TIMONEL_START - SPM_PAGESIZE)) {
+                        p_mem_pack->tpl_commit = false; // The trampoline was filled in with this page
+                    }
+#endif // APP_USE_TPL_PG
+#endif // AUTO_PAGE_ADDR && DEFER_TPL_COMMIT
+#if (AUTO_PAGE_ADDR && !(DEFER_TPL_COMMIT))
+                    uint16_t tpl = CalculateTrampoline(p_mem_pack);
                     if (p_mem_pack->page_addr == RESET_PAGE) {  // Calculate and write trampoline
                         for (int i = 0; i < SPM_PAGESIZE - 2; i += 2) {
                             boot_page_fill((TIMONEL_START - SPM_PAGESIZE) + i, 0xFFFF);
                         }
                         boot_page_fill((TIMONEL_START - 2), tpl);
+                        PROBE_ON(PROBE_SPM_PIN);
                         boot_page_write(TIMONEL_START - SPM_PAGESIZE);
+                        PROBE_OFF(PROBE_SPM_PIN);
+                        STATS_COUNT(page_writes);
                     }
 #if APP_USE_TPL_PG
                     if (p_mem_pack->page_addr == (TIMONEL_START - SPM_PAGESIZE)) {
@@ -336,11 +574,101 @@ int main(void) {
                         }
                     }
 #endif // APP_USE_TPL_PG
+#endif // AUTO_PAGE_ADDR && !DEFER_TPL_COMMIT
+#if AUTO_PAGE_ADDR
                     p_mem_pack->page_addr += SPM_PAGESIZE;
+#if UPLOAD_JOURNAL
+                    UpdateJournal(p_mem_pack->page_addr, p_mem_pack);
+#endif // UPLOAD_JOURNAL
+#elif UPLOAD_JOURNAL
+                    UpdateJournal(p_mem_pack->page_addr + SPM_PAGESIZE, p_mem_pack);
 #endif // AUTO_PAGE_ADDR
                     p_mem_pack->page_ix = 0;
                 }
+#if UPLOAD_JOURNAL
+                // ===================================================
+                // = Start a new journal for a new image (Slow-Op 4) =
+                // ===================================================
+                if ((p_mem_pack->flags >> FL_RST_JRNL) & true) {
+                    p_mem_pack->flags &= ~(1 << FL_RST_JRNL);
+                    UploadJournal *p_journal = (UploadJournal *)JOURNAL_EEPROM_ADDR;
+                    eeprom_update_word(&p_journal->image_id, p_mem_pack->image_id);
+                    UpdateJournal(RESET_PAGE, p_mem_pack);
+                }
+#endif // UPLOAD_JOURNAL
+#if CMD_PATCHPAGE
+                // =========================================================
+                // = Erase and rewrite the page with the patch (Slow-Op 5) =
+                // =========================================================
+                if ((p_mem_pack->flags >> FL_PATCH_PG) & true) {
+#if ENABLE_LED_UI
+                    LED_UI_PORT ^= (1 << LED_UI_PIN);   // Turn led on and off to indicate writing ...
+#endif // ENABLE_LED_UI
+                    p_mem_pack->flags &= ~(1 << FL_PATCH_PG);
+                    PROBE_ON(PROBE_SPM_PIN);
+                    boot_page_erase(p_mem_pack->patch_page);
+                    boot_page_write(p_mem_pack->patch_page);
+                    PROBE_OFF(PROBE_SPM_PIN);
+                    STATS_COUNT(page_erases);
+                    STATS_COUNT(page_writes);
+#if VERIFY_IMAGE
+                    ImageRecord *p_record = (ImageRecord *)IMAGE_EEPROM_ADDR;
+                    if (eeprom_read_byte(&p_record->state) == IMG_VALID) {
+                        eeprom_update_word(&p_record->image_crc, CalculateImageCrc());  // The patch is part of the image now
+                    }
+#endif // VERIFY_IMAGE
+                }
+#endif // CMD_PATCHPAGE
+#if CMD_ERASERANGE
+                // ======================================
+                // = Erase a range of pages (Slow-Op 6) =
+                // ======================================
+                if ((p_mem_pack->flags >> FL_ERASE_RNG) & true) {
+#if ENABLE_LED_UI
+                    LED_UI_PORT |= (1 << LED_UI_PIN);   // Turn led on to indicate erasing ...
+#endif // ENABLE_LED_UI
+                    p_mem_pack->flags &= ~(1 << FL_ERASE_RNG);
+#if VERIFY_IMAGE
+                    eeprom_update_byte(&((ImageRecord *)IMAGE_EEPROM_ADDR)->state, IMG_NONE);
+                    eeprom_busy_wait();                 // SPM is ignored while the EEPROM write runs
+#endif // VERIFY_IMAGE
+                    while (p_mem_pack->erase_count-- != 0) {
+                        PROBE_ON(PROBE_SPM_PIN);
+                        boot_page_erase(p_mem_pack->erase_page);
+                        PROBE_OFF(PROBE_SPM_PIN);
+                        STATS_COUNT(page_erases);
+                        TICK_UPDATE();
+                        p_mem_pack->erase_page += SPM_PAGESIZE;
+                    }
+#if UPLOAD_JOURNAL
+                    // Pages counted as committed by the journal might be gone, rewind it
+                    p_mem_pack->upload_crc = 0;
+                    UpdateJournal(RESET_PAGE, p_mem_pack);
+#endif // UPLOAD_JOURNAL
+#if ENABLE_LED_UI
+                    LED_UI_PORT &= ~(1 << LED_UI_PIN);  // Turn led off when done
+#endif // ENABLE_LED_UI
+                }
+#endif // CMD_ERASERANGE
+                TRACE_EVENT(TR_SLOW_OPS_END, p_mem_pack->flags);
+            }
+#if USI_IDLE_SLEEP
+            // Nothing to do until the next bus event: sleep in idle mode. USISIE is always set and USIOIE is set
+            // during transactions, so the USI flags wake the CPU up. With interrupts globally disabled no vector
+            // runs, execution continues after the sleep instruction and the handlers above are polled as usual.
+            // The USI stop flag has no interrupt: don't sleep while a master write may end with a stop condition.
+            if (!(((USISR >> TWI_START_COND_FLAG) & (USICR >> TWI_START_COND_INT) & true) ||
+                  ((USISR >> USI_OVERFLOW_FLAG) & (USICR >> USI_OVERFLOW_INT) & true))
+#if USI_STOP_DETECT
+                && (twi_ctx.device_state != STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK)
+#endif  // USI_STOP_DETECT
+            ) {
+                sleep_cpu();
+#if ENABLE_STATS
+                loop_start = GetTicks();    // The time spent sleeping doesn't count as loop time
+#endif  // ENABLE_STATS
             }
+#endif  // USI_IDLE_SLEEP
         /*..................................
           :                                 .
           :   Bootloader NOT initialized     .
@@ -353,7 +681,11 @@ int main(void) {
                 LED_UI_PORT ^= (1 << LED_UI_PIN);   // If Timonel isn't initialized, led blinks at LED_DLY intervals
 #endif // ENABLE_LED_UI
 #if APP_AUTORUN
+#if VERIFY_IMAGE
+                if ((exit_delay-- == 0) && (ValidateImage(p_mem_pack) == true)) {
+#else
                 if (exit_delay-- == 0) {
+#endif // VERIFY_IMAGE
                     // ========================================
                     // = >>> Timeout: Run the application <<< =
                     // ========================================
@@ -372,6 +704,19 @@ int main(void) {
                     RestorePrescaler();             // Restore prescaler factor to divide by 8
 #endif // LOW_FUSE & 0x80
 #endif // AUTO_CLK_TWEAK
+#if USE_TICK_TIMER
+                    TICK_TIMER_CTL = 0;             // Stop the tick timer
+#endif // USE_TICK_TIMER
+#if USI_IDLE_SLEEP
+#if USE_TICK_TIMER
+                    TICK_TIMER_IMSK &= ~(1 << TOIE0);
+#endif // USE_TICK_TIMER
+                    sleep_disable();                // Leave the sleep settings as they were at reset
+#endif // USI_IDLE_SLEEP
+#if ENABLE_PROBES
+                    PROBE_PORT &= ~((1 << PROBE_TWI_PIN) | (1 << PROBE_OVF_PIN) | (1 << PROBE_SPM_PIN));  // Release the probe pins
+                    PROBE_DDR &= ~((1 << PROBE_TWI_PIN) | (1 << PROBE_OVF_PIN) | (1 << PROBE_SPM_PIN));   // to the application
+#endif // ENABLE_PROBES
                     RunApplication();               // Count from CYCLESTOEXIT to 0, then exit to the application
                 }
 #endif // APP_AUTORUN
@@ -406,7 +751,11 @@ inline void ReceiveEvent(const uint8_t *command, MemPack *p_mem_pack) {
             return;
         }
 #endif  // CMD_SETPGADDR || !AUTO_PAGE_ADDR
-        case WRITPAGE: {
+        case WRITPAGE:
+#if BATCH_WRITES
+        case WRTBATCH:
+#endif  // BATCH_WRITES
+        {
             Reply_WRITPAGE(command, p_mem_pack);
             return;
         }
@@ -428,6 +777,18 @@ inline void ReceiveEvent(const uint8_t *command, MemPack *p_mem_pack) {
             return;
         }
 #endif  // CMD_READDEVS
+#if CMD_GETCAPAB
+        case GETCAPAB: {
+            Reply_GETCAPAB();
+            return;
+        }
+#endif  // CMD_GETCAPAB
+#if BATCH_WRITES
+        case GETBATCH: {
+            Reply_GETBATCH(p_mem_pack);
+            return;
+        }
+#endif  // BATCH_WRITES
 #if EEPROM_ACCESS
         case WRITEEPR: {
             Reply_WRITEEPR(command);
@@ -438,8 +799,53 @@ inline void ReceiveEvent(const uint8_t *command, MemPack *p_mem_pack) {
             return;
         }        
 #endif  // EEPROM_ACCESS
+#if CMD_PATCHPAGE
+        case PATCHPAG: {
+            Reply_PATCHPAG(command, p_mem_pack);
+            return;
+        }
+#endif  // CMD_PATCHPAGE
+#if CMD_ERASERANGE
+        case ERASERNG: {
+            Reply_ERASERNG(command, p_mem_pack);
+            return;
+        }
+#endif  // CMD_ERASERANGE
+#if ENABLE_STATS
+        case GETSTATS: {
+            Reply_GETSTATS(command);
+            return;
+        }
+#endif  // ENABLE_STATS
+#if ENABLE_TRACE
+        case GETTRACE: {
+            Reply_GETTRACE();
+            return;
+        }
+#endif  // ENABLE_TRACE
+#if CMD_BUSTEST
+        case ECHOTEST: {
+            Reply_ECHOTEST(command);
+            return;
+        }
+        case SINKTEST: {
+            Reply_SINKTEST(command);
+            return;
+        }
+        case SRCETEST: {
+            Reply_SRCETEST(command);
+            return;
+        }
+#endif  // CMD_BUSTEST
+#if UPLOAD_JOURNAL
+        case GETRESUM: {
+            Reply_GETRESUM(command, p_mem_pack);
+            return;
+        }
+#endif  // UPLOAD_JOURNAL
         default: {
-            UsiTwiTransmitByte(UNKNOWNC);
+            UsiTwiTransmitByte(&twi_ctx, UNKNOWNC);
+            STATS_COUNT(unknown_cmds);
         }
     }
 }
@@ -469,9 +875,7 @@ inline void Reply_GETTMNLV(MemPack *p_mem_pack) {
 #if ENABLE_LED_UI
     LED_UI_PORT &= ~(1 << LED_UI_PIN);  // Turn led off to indicate initialization
 #endif                                  // ENABLE_LED_UI
-    for (uint8_t i = 0; i < GETTMNLV_RPLYLN; i++) {
-        UsiTwiTransmitByte(reply[i]);
-    }
+    TransmitReply(reply, GETTMNLV_RPLYLN);
 }
 
 /* ____________________
@@ -480,7 +884,15 @@ inline void Reply_GETTMNLV(MemPack *p_mem_pack) {
   |____________________|
 */
 inline void Reply_EXITTMNL(MemPack *p_mem_pack) {
-    UsiTwiTransmitByte(ACKEXITT);
+#if VERIFY_PAGE
+    if ((p_mem_pack->flags >> FL_PAGE_ERR) & true) {
+        // The last page written is corrupt, keep the bootloader running
+        p_mem_pack->flags &= ~(1 << FL_PAGE_ERR);
+        UsiTwiTransmitByte(&twi_ctx, ERRWTPAG);
+        return;
+    }
+#endif  // VERIFY_PAGE
+    UsiTwiTransmitByte(&twi_ctx, ACKEXITT);
     p_mem_pack->flags |= (1 << FL_EXIT_TML);
     p_mem_pack->flags |= (1 << FL_INIT_1);
 }
@@ -491,7 +903,7 @@ inline void Reply_EXITTMNL(MemPack *p_mem_pack) {
   |____________________|
 */
 inline void Reply_DELFLASH(MemPack *p_mem_pack) {
-    UsiTwiTransmitByte(ACKDELFL);
+    UsiTwiTransmitByte(&twi_ctx, ACKDELFL);
     p_mem_pack->flags |= (1 << FL_DEL_FLASH);
 }
 
@@ -502,14 +914,12 @@ inline void Reply_DELFLASH(MemPack *p_mem_pack) {
   |____________________|
 */
 inline void Reply_STPGADDR(const uint8_t *command, MemPack *p_mem_pack) {
-    uint8_t reply[STPGADDR_RPLYLN] = {0};
+    uint8_t reply[STPGADDR_RPLYLN];
     p_mem_pack->page_addr = ((command[2] << 8) | command[1]);  // Sets the flash memory page base address
     p_mem_pack->page_addr &= ~(SPM_PAGESIZE - 1);              // Keep only pages' base addresses
     reply[0] = AKPGADDR;
     reply[1] = (uint8_t)(command[1] + command[2]);  // Returns the sum of LSB and MSB of the page address
-    for (uint8_t i = 0; i < STPGADDR_RPLYLN; i++) {
-        UsiTwiTransmitByte(reply[i]);
-    }
+    TransmitReply(reply, STPGADDR_RPLYLN);
 }
 #endif // (CMD_SETPGADDR || !AUTO_PAGE_ADDR)
 
@@ -521,7 +931,37 @@ inline void Reply_STPGADDR(const uint8_t *command, MemPack *p_mem_pack) {
 inline void Reply_WRITPAGE(const uint8_t *command, MemPack *p_mem_pack) {
     uint8_t reply[WRITPAGE_RPLYLN] = {0};
     uint8_t page_loop_start = 0;
+#if BATCH_WRITES
+    const bool batch = (command[0] == WRTBATCH);  // Batched frames don't have a reply
+#endif  // BATCH_WRITES
     reply[0] = ACKWTPAG;
+#if VERIFY_PAGE
+    if ((p_mem_pack->flags >> FL_PAGE_ERR) & true) {
+        p_mem_pack->flags &= ~(1 << FL_PAGE_ERR);
+        reply[0] = ERRWTPAG;    // The previous page doesn't match, this one is still accepted
+    }
+#endif  // VERIFY_PAGE
+#if WRITPAGE_VARLEN
+    const uint8_t data_len = command[1];    // Data bytes sent, the rest of the packet is left erased
+    if ((data_len > MST_PACKET_SIZE) || (data_len & 1) ||
+        (((p_mem_pack->page_addr + p_mem_pack->page_ix) == RESET_PAGE) && (data_len < 2))) {
+        p_mem_pack->flags |= (1 << FL_DEL_FLASH);   // Wrong length, safety payload deletion ...
+        STATS_COUNT(checksum_errors);
+#if BATCH_WRITES
+        if (batch == true) {
+            p_mem_pack->batch_frames++;
+            p_mem_pack->batch_status |= (1 << BT_ERR_CHECKSUM);
+            return;
+        }
+#endif  // BATCH_WRITES
+        TransmitReply(reply, WRITPAGE_RPLYLN);
+        return;
+    }
+    reply[1] = data_len;                    // The length is part of the checksum
+    command++;                              // Skip the length byte: data and checksum as in fixed-length frames
+#else
+    const uint8_t data_len = MST_PACKET_SIZE;
+#endif  // WRITPAGE_VARLEN
     if ((p_mem_pack->page_addr + p_mem_pack->page_ix) == RESET_PAGE) {
 #if AUTO_PAGE_ADDR
         p_mem_pack->app_reset_lsb = command[1];
@@ -531,30 +971,121 @@ inline void Reply_WRITPAGE(const uint8_t *command, MemPack *p_mem_pack) {
         // WARNING: This only works when CMD_SETPGADDR is disabled. If CMD_SETPGADDR is enabled,
         // the reset vector modification MUST BE done by the TWI master's upload program.
         // Otherwise, Timonel won't have the execution control after power-on reset.
+#if VERIFY_IMAGE
+        // A new application is being written, the recorded one is gone. This must be done before
+        // the first page fill: an EEPROM write while the page buffer is loaded discards its data.
+        eeprom_update_byte(&((ImageRecord *)IMAGE_EEPROM_ADDR)->state, IMG_NONE);
+        eeprom_busy_wait();
+#endif  // VERIFY_IMAGE
         boot_page_fill((RESET_PAGE), (0xC000 + ((TIMONEL_START / 2) - 1)));
         reply[1] += (uint8_t)((command[1]) + command[2]);  // Reply checksum accumulator
+#if VERIFY_PAGE
+        p_mem_pack->page_sum += (0xC000 + ((TIMONEL_START / 2) - 1));
+#endif  // VERIFY_PAGE
+#if (UPLOAD_JOURNAL || VERIFY_IMAGE)
+        p_mem_pack->upload_crc = _crc16_update(p_mem_pack->upload_crc, command[1]);
+        p_mem_pack->upload_crc = _crc16_update(p_mem_pack->upload_crc, command[2]);
+#endif  // UPLOAD_JOURNAL || VERIFY_IMAGE
         p_mem_pack->page_ix += 2;
         page_loop_start = 3;
     } else {
         page_loop_start = 1;
     }
-    for (uint8_t i = page_loop_start; i < (MST_PACKET_SIZE + 1); i += 2) {
-        boot_page_fill((p_mem_pack->page_addr + p_mem_pack->page_ix), ((command[i + 1] << 8) | command[i]));
+    for (uint8_t i = page_loop_start; i < (data_len + 1); i += 2) {
+        uint16_t page_word = ((command[i + 1] << 8) | command[i]);
+#if (DEFER_TPL_COMMIT && APP_USE_TPL_PG)
+        if ((p_mem_pack->page_addr + p_mem_pack->page_ix) == (TIMONEL_START - 2)) {
+            page_word = TrampolineWord(page_word, p_mem_pack);
+        }
+#endif  // DEFER_TPL_COMMIT && APP_USE_TPL_PG
+        boot_page_fill((p_mem_pack->page_addr + p_mem_pack->page_ix), page_word);
         reply[1] += (uint8_t)((command[i]) + command[i + 1]);
+#if VERIFY_PAGE
+        p_mem_pack->page_sum += page_word;
+#endif  // VERIFY_PAGE
+#if (UPLOAD_JOURNAL || VERIFY_IMAGE)
+        p_mem_pack->upload_crc = _crc16_update(p_mem_pack->upload_crc, command[i]);
+        p_mem_pack->upload_crc = _crc16_update(p_mem_pack->upload_crc, command[i + 1]);
+#endif  // UPLOAD_JOURNAL || VERIFY_IMAGE
+        p_mem_pack->page_ix += 2;
+    }
+#if WRITPAGE_VARLEN
+    for (uint8_t i = data_len; i < MST_PACKET_SIZE; i += 2) {
+        // Words not sent aren't filled, they keep the erased state of the temporary buffer (0xFFFF)
+#if (DEFER_TPL_COMMIT && APP_USE_TPL_PG)
+        if ((p_mem_pack->page_addr + p_mem_pack->page_ix) == (TIMONEL_START - 2)) {
+            boot_page_fill((TIMONEL_START - 2), TrampolineWord(0xFFFF, p_mem_pack));
+#if VERIFY_PAGE
+            p_mem_pack->page_sum += CalculateTrampoline(p_mem_pack);
+#endif  // VERIFY_PAGE
+        } else
+#endif  // DEFER_TPL_COMMIT && APP_USE_TPL_PG
+        {
+#if VERIFY_PAGE
+            p_mem_pack->page_sum += 0xFFFF;
+#endif  // VERIFY_PAGE
+        }
+#if (UPLOAD_JOURNAL || VERIFY_IMAGE)
+        p_mem_pack->upload_crc = _crc16_update(p_mem_pack->upload_crc, 0xFF);
+        p_mem_pack->upload_crc = _crc16_update(p_mem_pack->upload_crc, 0xFF);
+#endif  // UPLOAD_JOURNAL || VERIFY_IMAGE
         p_mem_pack->page_ix += 2;
     }
+#endif  // WRITPAGE_VARLEN
 #if CHECK_PAGE_IX
-    if ((reply[1] != command[MST_PACKET_SIZE + 1]) || (p_mem_pack->page_ix > SPM_PAGESIZE)) {
+    if ((reply[1] != command[data_len + 1]) || (p_mem_pack->page_ix > SPM_PAGESIZE)) {
 #else
-    if (reply[1] != command[MST_PACKET_SIZE + 1]) {
+    if (reply[1] != command[data_len + 1]) {
 #endif                                              // CHECK_PAGE_IX
         p_mem_pack->flags |= (1 << FL_DEL_FLASH);   // If checksums don't match, safety payload deletion ...
+        STATS_COUNT(checksum_errors);
+#if BATCH_WRITES
+        p_mem_pack->batch_status |= (1 << BT_ERR_CHECKSUM);
+#endif  // BATCH_WRITES
         reply[1] = 0;
     }
-    for (uint8_t i = 0; i < WRITPAGE_RPLYLN; i++) {
-        UsiTwiTransmitByte(reply[i]);
+#if BATCH_WRITES
+    if (batch == true) {
+        // No reply: the outcome is added to the batch status, which is read with GETBATCH
+        p_mem_pack->batch_frames++;
+        p_mem_pack->batch_sum += reply[1];
+        if (reply[0] == ERRWTPAG) {
+            p_mem_pack->batch_status |= (1 << BT_ERR_PAGE);
+        }
+        return;
     }
+#endif  // BATCH_WRITES
+    TransmitReply(reply, WRITPAGE_RPLYLN);
+}
+
+#if AUTO_PAGE_ADDR
+/* _________________________
+  |                         |
+  |   CalculateTrampoline   |
+  |_________________________|
+*/
+inline uint16_t CalculateTrampoline(MemPack *p_mem_pack) {
+    // Relative jump from the word before the bootloader to the application reset vector target
+    return (((~((TIMONEL_START >> 1) - ((((p_mem_pack->app_reset_msb << 8) | p_mem_pack->app_reset_lsb) + 1) & 0x0FFF)) + 1) & 0x0FFF) | 0xC000);
 }
+#endif // AUTO_PAGE_ADDR
+
+#if (DEFER_TPL_COMMIT && APP_USE_TPL_PG)
+/* ____________________
+  |                    |
+  |   TrampolineWord   |
+  |____________________|
+*/
+uint16_t TrampolineWord(const uint16_t app_word, MemPack *p_mem_pack) {
+    // The trampoline page is being received: its last word is filled with the trampoline now,
+    // so that page is written once by Slow-Op 3 instead of being rewritten on exit.
+    if (app_word != 0xFFFF) {
+        // If the application overwrites the trampoline bytes, delete it!
+        p_mem_pack->flags |= (1 << FL_DEL_FLASH);
+    }
+    return CalculateTrampoline(p_mem_pack);
+}
+#endif // DEFER_TPL_COMMIT && APP_USE_TPL_PG
 
 #if CMD_READFLASH
 /* ____________________
@@ -577,9 +1108,7 @@ inline void Reply_READFLSH(const uint8_t *command) {
     }
     reply[reply_len - 1] += (uint8_t)(command[1]);      // Add Received address LSB to checksum
     reply[reply_len - 1] += (uint8_t)(command[2]);      // Add Received address MSB to checksum
-    for (uint8_t i = 0; i < reply_len; i++) {
-        UsiTwiTransmitByte(reply[i]);
-    }
+    TransmitReply(reply, reply_len);
 #if ENABLE_LED_UI
     LED_UI_PORT ^= (1 << LED_UI_PIN);       // Blinks whenever a memory data block is sent
 #endif // ENABLE_LED_UI
@@ -593,7 +1122,7 @@ inline void Reply_READFLSH(const uint8_t *command) {
 */
 inline void Reply_INITSOFT(MemPack *p_mem_pack) {
     p_mem_pack->flags |= (1 << FL_INIT_2);  // Two-step init step 1: receive INITSOFT command
-    UsiTwiTransmitByte(ACKINITS);
+    UsiTwiTransmitByte(&twi_ctx, ACKINITS);
 }
 
 #if CMD_READDEVS
@@ -614,12 +1143,73 @@ inline void Reply_READDEVS(void) {
     reply[7] = boot_signature_byte_get(0x04);                   // Signature byte 2
     reply[8] = boot_signature_byte_get(0x01);                   // Calibration data for internal oscillator at 8.0 MHz
     reply[9] = boot_signature_byte_get(0x03);                   // Calibration data for internal oscillator at 6.4 MHz
-    for (uint8_t i = 0; i < READDEVS_RPLYLN; i++) {
-        UsiTwiTransmitByte(reply[i]);
-    }
+    TransmitReply(reply, READDEVS_RPLYLN);
 }
 #endif // READDEVS
 
+#if CMD_GETCAPAB
+/* ____________________
+  |                    |
+  |   Reply_GETCAPAB   |
+  |____________________|
+*/
+inline void Reply_GETCAPAB(void) {
+    // Reply: ACKCAPAB, 16-bit values LSB first, checksum
+    uint8_t reply[GETCAPAB_RPLYLN];
+    reply[0] = ACKCAPAB;
+    reply[1] = (SPM_PAGESIZE & 0xFF);                       // Flash page size LSB
+    reply[2] = ((SPM_PAGESIZE & 0xFF00) >> 8);              // Flash page size MSB
+    reply[3] = MST_PACKET_SIZE;                             // Master-to-slave packet size (WRITPAGE data bytes)
+    reply[4] = SLV_PACKET_SIZE;                             // Slave-to-master packet size
+    reply[5] = (TWI_RX_BUFFER_SIZE & 0xFF);                 // TWI RX buffer size LSB
+    reply[6] = ((TWI_RX_BUFFER_SIZE & 0xFF00) >> 8);        // TWI RX buffer size MSB
+    reply[7] = (TWI_TX_BUFFER_SIZE & 0xFF);                 // TWI TX buffer size LSB
+    reply[8] = ((TWI_TX_BUFFER_SIZE & 0xFF00) >> 8);        // TWI TX buffer size MSB
+    reply[9] = ((FLASHEND + 1) & 0xFF);                     // Flash memory size LSB
+    reply[10] = (((FLASHEND + 1) & 0xFF00) >> 8);           // Flash memory size MSB
+    reply[11] = ((E2END + 1) & 0xFF);                       // EEPROM size LSB
+    reply[12] = (((E2END + 1) & 0xFF00) >> 8);              // EEPROM size MSB
+    reply[13] = boot_signature_byte_get(0x00);              // Signature byte 0
+    reply[14] = boot_signature_byte_get(0x02);              // Signature byte 1
+    reply[15] = boot_signature_byte_get(0x04);              // Signature byte 2
+    reply[16] = ((F_CPU / 1000) & 0xFF);                    // CPU clock the bootloader was built for, in kHz, LSB
+    reply[17] = (((F_CPU / 1000) & 0xFF00) >> 8);           // CPU clock in kHz, MSB
+    reply[18] = CLKPR;                                      // Clock prescaler in use
+    reply[19] = OSCCAL;                                     // Internal RC oscillator calibration in use
+    reply[20] = (TML_ADD_FEATURES & 0xFF);                  // Additional features LSB
+    reply[21] = ((TML_ADD_FEATURES & 0xFF00) >> 8);         // Additional features MSB
+    reply[22] = TWI_ADDR;                                   // Bootloader TWI address
+    reply[GETCAPAB_RPLYLN - 1] = 0;
+    for (uint8_t i = 1; i < (GETCAPAB_RPLYLN - 1); i++) {
+        reply[GETCAPAB_RPLYLN - 1] += reply[i];             // Returns the sum of all the reply bytes but the ack
+    }
+    TransmitReply(reply, GETCAPAB_RPLYLN);
+}
+#endif // CMD_GETCAPAB
+
+#if BATCH_WRITES
+/* ____________________
+  |                    |
+  |   Reply_GETBATCH   |
+  |____________________|
+*/
+inline void Reply_GETBATCH(MemPack *p_mem_pack) {
+    // Reply: ACKBATCH, frames LSB, MSB, status, rolling checksum LSB, MSB, checksum
+    uint8_t reply[GETBATCH_RPLYLN];
+    reply[0] = ACKBATCH;
+    reply[1] = (uint8_t)(p_mem_pack->batch_frames & 0xFF);          // Frames processed LSB
+    reply[2] = (uint8_t)((p_mem_pack->batch_frames & 0xFF00) >> 8); // Frames processed MSB
+    reply[3] = p_mem_pack->batch_status;                            // Error bits
+    reply[4] = (uint8_t)(p_mem_pack->batch_sum & 0xFF);             // Rolling checksum LSB
+    reply[5] = (uint8_t)((p_mem_pack->batch_sum & 0xFF00) >> 8);    // Rolling checksum MSB
+    reply[6] = (uint8_t)(reply[1] + reply[2] + reply[3] + reply[4] + reply[5]);
+    p_mem_pack->batch_frames = 0;                                   // A new batch starts
+    p_mem_pack->batch_sum = 0;
+    p_mem_pack->batch_status = 0;
+    TransmitReply(reply, GETBATCH_RPLYLN);
+}
+#endif // BATCH_WRITES
+
 #if EEPROM_ACCESS
 /* ____________________
   |                    |
@@ -627,15 +1217,13 @@ inline void Reply_READDEVS(void) {
   |____________________|
 */
 inline void Reply_WRITEEPR(const uint8_t *command) {
-    uint8_t reply[WRITEEPR_RPLYLN] = {0};
+    uint8_t reply[WRITEEPR_RPLYLN];
     uint16_t eeprom_addr = ((command[2] << 8) | command[1]);    // Set the EEPROM address
     eeprom_addr &= E2END;                                       // Keep only valid EEPROM addresses
     reply[0] = ACKWTEEP;
     reply[1] = (uint8_t)(command[1] + command[2] + command[3]); // Returns the sum of the EEPROM address LSB, MSB, and data byte
     eeprom_update_byte((uint8_t *)eeprom_addr, command[3]);
-    for (uint8_t i = 0; i < WRITEEPR_RPLYLN; i++) {
-        UsiTwiTransmitByte(reply[i]);
-    }    
+    TransmitReply(reply, WRITEEPR_RPLYLN);
 }
 
 /* ____________________
@@ -644,18 +1232,413 @@ inline void Reply_WRITEEPR(const uint8_t *command) {
   |____________________|
 */
 inline void Reply_READEEPR(const uint8_t *command) {
-    uint8_t reply[READEEPR_RPLYLN] = {0};
+    uint8_t reply[READEEPR_RPLYLN];
     uint16_t eeprom_addr = ((command[2] << 8) | command[1]);    // Set the EEPROM address
     eeprom_addr &= E2END;                                       // Keep only valid EEPROM addresses
     reply[0] = ACKRDEEP;
     reply[1] = (uint8_t)eeprom_read_byte((uint8_t *)eeprom_addr);
     reply[2] = (uint8_t)(command[1] + command[2] + reply[1]);   // Returns the sum of EEPROM address LSB, MSB and data byte
-    for (uint8_t i = 0; i < READEEPR_RPLYLN; i++) {
-        UsiTwiTransmitByte(reply[i]);
-    } 
+    TransmitReply(reply, READEEPR_RPLYLN);
 }
 #endif // EEPROM_ACCESS
 
+#if UPLOAD_JOURNAL
+/* ____________________
+  |                    |
+  |   Reply_GETRESUM   |
+  |____________________|
+*/
+inline void Reply_GETRESUM(const uint8_t *command, MemPack *p_mem_pack) {
+    uint8_t reply[GETRESUM_RPLYLN] = {0};
+    UploadJournal *p_journal = (UploadJournal *)JOURNAL_EEPROM_ADDR;
+    p_mem_pack->image_id = ((command[2] << 8) | command[1]);   // Image ID of the upload to resume
+    uint16_t next_page = eeprom_read_word(&p_journal->next_page);
+    if ((eeprom_read_word(&p_journal->image_id) == p_mem_pack->image_id) && (next_page < TIMONEL_START)) {
+        // Same image: resume the upload from the first page not committed to flash
+        p_mem_pack->page_addr = next_page;
+        p_mem_pack->upload_crc = eeprom_read_word(&p_journal->upload_crc);
+#if AUTO_PAGE_ADDR
+        p_mem_pack->app_reset_lsb = eeprom_read_byte(&p_journal->app_reset_lsb);
+        p_mem_pack->app_reset_msb = eeprom_read_byte(&p_journal->app_reset_msb);
+#endif // AUTO_PAGE_ADDR
+#if DEFER_TPL_COMMIT
+        p_mem_pack->tpl_commit = (next_page != RESET_PAGE);  // Page 0 is already in flash
+#endif // DEFER_TPL_COMMIT
+    } else {
+        // New image: the upload starts over from page 0, the journal is reset as a slow operation
+        p_mem_pack->page_addr = RESET_PAGE;
+        p_mem_pack->upload_crc = 0;
+        p_mem_pack->flags |= (1 << FL_RST_JRNL);
+    }
+    p_mem_pack->page_ix = 0;
+#if VERIFY_PAGE
+    p_mem_pack->page_sum = 0;
+#endif // VERIFY_PAGE
+    boot_temp_buff_erase();                                     // Drop any partially received page
+    reply[0] = ACKRESUM;
+    reply[1] = (uint8_t)(p_mem_pack->page_addr & 0xFF);                 // Resume page address LSB
+    reply[2] = (uint8_t)((p_mem_pack->page_addr & 0xFF00) >> 8);        // Resume page address MSB
+    reply[3] = (uint8_t)(p_mem_pack->upload_crc & 0xFF);                // Running CRC LSB
+    reply[4] = (uint8_t)((p_mem_pack->upload_crc & 0xFF00) >> 8);       // Running CRC MSB
+    reply[5] = (uint8_t)(reply[1] + reply[2] + reply[3] + reply[4]);    // Returns the sum of the address and CRC bytes
+    TransmitReply(reply, GETRESUM_RPLYLN);
+}
+
+/* ___________________
+  |                   |
+  |   UpdateJournal   |
+  |___________________|
+*/
+inline void UpdateJournal(const uint16_t next_page, MemPack *p_mem_pack) {
+    // Record the upload progress in EEPROM. Only the bytes that change are rewritten.
+    UploadJournal *p_journal = (UploadJournal *)JOURNAL_EEPROM_ADDR;
+    eeprom_update_word(&p_journal->next_page, next_page);
+    eeprom_update_word(&p_journal->upload_crc, p_mem_pack->upload_crc);
+#if AUTO_PAGE_ADDR
+    eeprom_update_byte(&p_journal->app_reset_lsb, p_mem_pack->app_reset_lsb);
+    eeprom_update_byte(&p_journal->app_reset_msb, p_mem_pack->app_reset_msb);
+#endif // AUTO_PAGE_ADDR
+    eeprom_busy_wait();  // SPM is ignored while the EEPROM write runs: the next page fill would be lost
+}
+#endif // UPLOAD_JOURNAL
+
+#if VERIFY_IMAGE
+/* ___________________
+  |                   |
+  |   ValidateImage   |
+  |___________________|
+*/
+bool ValidateImage(MemPack *p_mem_pack) {
+    ImageRecord *p_record = (ImageRecord *)IMAGE_EEPROM_ADDR;
+    if ((p_mem_pack->page_addr != RESET_PAGE) && (p_mem_pack->page_ix == 0)) {
+        // Whole pages were uploaded: record the application length and digest, to be checked below
+        eeprom_update_word(&p_record->image_len, p_mem_pack->page_addr);
+        eeprom_update_word(&p_record->image_crc, p_mem_pack->upload_crc);
+        eeprom_update_byte(&p_record->app_reset_lsb, p_mem_pack->app_reset_lsb);
+        eeprom_update_byte(&p_record->app_reset_msb, p_mem_pack->app_reset_msb);
+        eeprom_update_byte(&p_record->state, IMG_PENDING);
+    }
+    uint8_t state = eeprom_read_byte(&p_record->state);
+    if (state == IMG_PENDING) {
+        // First start after an upload: check the whole image once and keep the outcome
+        state = ((CalculateImageCrc() == eeprom_read_word(&p_record->image_crc)) ? IMG_VALID : IMG_NONE);
+        eeprom_update_byte(&p_record->state, state);
+    }
+    if (state != IMG_VALID) {
+        p_mem_pack->flags &= ~(1 << FL_EXIT_TML);  // No valid application, keep the bootloader running
+        return false;
+    }
+    return true;
+}
+
+/* _______________________
+  |                       |
+  |   CalculateImageCrc   |
+  |_______________________|
+*/
+uint16_t CalculateImageCrc(void) {
+    // CRC-16 of the recorded application length. The first word in flash is the
+    // jump to the bootloader, so the application reset vector is used instead. The
+    // last word before the bootloader holds the trampoline, which wasn't part of the
+    // received data: it's hashed as erased, as it was received.
+    ImageRecord *p_record = (ImageRecord *)IMAGE_EEPROM_ADDR;
+    uint16_t image_len = eeprom_read_word(&p_record->image_len);
+    uint16_t crc = _crc16_update(0, eeprom_read_byte(&p_record->app_reset_lsb));
+    crc = _crc16_update(crc, eeprom_read_byte(&p_record->app_reset_msb));
+    const __flash uint8_t *mem_position = (void *)(RESET_PAGE + 2);
+    for (uint16_t i = 2; (i < image_len) && (i < TIMONEL_START); i++) {
+        crc = _crc16_update(crc, ((i < (TIMONEL_START - 2)) ? *mem_position : 0xFF));
+        mem_position++;
+        if ((i & (SPM_PAGESIZE - 1)) == 0) {
+            TICK_UPDATE();
+        }
+    }
+    return crc;
+}
+#endif // VERIFY_IMAGE
+
+#if CMD_PATCHPAGE
+/* ____________________
+  |                    |
+  |   Reply_PATCHPAG   |
+  |____________________|
+*/
+inline void Reply_PATCHPAG(const uint8_t *command, MemPack *p_mem_pack) {
+    uint8_t reply[PATCHPAG_RPLYLN] = {0};
+    uint16_t patch_addr = ((command[2] << 8) | command[1]);    // First flash memory address to patch
+    uint8_t patch_len = command[3];                             // Amount of bytes to patch
+    reply[0] = ACKPATCH;
+    reply[1] = (uint8_t)(command[1] + command[2]);              // Reply checksum accumulator
+    for (uint8_t i = 0; (i < patch_len) && (i < PATCHPAG_MAXLN); i++) {
+        reply[1] += (uint8_t)(command[i + 4]);
+    }
+    // The patch has to fit in a single page, and it can't touch the reset vector, the trampoline
+    // or the bootloader. It's also rejected while an uploaded page is half-filled in the buffer.
+    if ((patch_len == 0) || (patch_len > PATCHPAG_MAXLN) ||
+        (reply[1] != command[patch_len + 4]) ||
+        (((patch_addr & (SPM_PAGESIZE - 1)) + patch_len) > SPM_PAGESIZE) ||
+        (patch_addr < 2) || ((patch_addr + patch_len) > (TIMONEL_START - 2)) ||
+        (p_mem_pack->page_ix != 0) || ((p_mem_pack->flags >> FL_PATCH_PG) & true)) {
+        reply[1] = 0;
+    } else {
+        // Load the current page contents into the temporary buffer, overlaying the new bytes
+        p_mem_pack->patch_page = (patch_addr & ~(SPM_PAGESIZE - 1));
+        const __flash uint8_t *mem_position;
+        mem_position = (void *)p_mem_pack->patch_page;
+        boot_temp_buff_erase();
+        for (uint8_t i = 0; i < SPM_PAGESIZE; i += 2) {
+            uint16_t word_addr = (p_mem_pack->patch_page + i);
+            uint8_t data_lsb = *(mem_position++);
+            uint8_t data_msb = *(mem_position++);
+            if ((uint16_t)(word_addr - patch_addr) < patch_len) {
+                data_lsb = command[(word_addr - patch_addr) + 4];
+            }
+            if ((uint16_t)(word_addr + 1 - patch_addr) < patch_len) {
+                data_msb = command[(word_addr + 1 - patch_addr) + 4];
+            }
+            boot_page_fill(word_addr, ((data_msb << 8) | data_lsb));
+        }
+        p_mem_pack->flags |= (1 << FL_PATCH_PG);    // Erase and write the page as a slow operation
+    }
+    TransmitReply(reply, PATCHPAG_RPLYLN);
+}
+#endif // CMD_PATCHPAGE
+
+#if CMD_ERASERANGE
+/* ____________________
+  |                    |
+  |   Reply_ERASERNG   |
+  |____________________|
+*/
+inline void Reply_ERASERNG(const uint8_t *command, MemPack *p_mem_pack) {
+    uint8_t reply[ERASERNG_RPLYLN];
+    uint16_t first_page = ((command[2] << 8) | command[1]);    // First page base address
+    first_page &= ~(SPM_PAGESIZE - 1);                          // Keep only pages' base addresses
+    reply[0] = ACKERASR;
+    // The range can't include the reset page, the trampoline page nor the bootloader
+    if ((command[3] == 0) || (first_page == RESET_PAGE) ||
+        (first_page >= (TIMONEL_START - SPM_PAGESIZE)) ||
+        ((first_page + ((uint16_t)command[3] * SPM_PAGESIZE)) > (TIMONEL_START - SPM_PAGESIZE)) ||
+        ((p_mem_pack->flags >> FL_ERASE_RNG) & true)) {
+        reply[1] = 0;
+    } else {
+        p_mem_pack->erase_page = first_page;
+        p_mem_pack->erase_count = command[3];
+        p_mem_pack->flags |= (1 << FL_ERASE_RNG);   // Erase the pages as a slow operation
+        reply[1] = (uint8_t)(command[1] + command[2] + command[3]); // Returns the sum of the page address LSB, MSB and page count
+    }
+    TransmitReply(reply, ERASERNG_RPLYLN);
+}
+#endif // CMD_ERASERANGE
+
+#if ENABLE_STATS
+/* ____________________
+  |                    |
+  |   Reply_GETSTATS   |
+  |____________________|
+*/
+inline void Reply_GETSTATS(const uint8_t *command) {
+    // Reply: ACKSTATS, counters (LSB first, "TmlStats" order), start timeouts LSB, MSB, checksum
+    uint8_t checksum = 0;
+    const uint8_t *p_stats = (const uint8_t *)&stats;
+    UsiTwiTransmitByte(&twi_ctx, ACKSTATS);
+    for (uint8_t i = 0; i < sizeof(TmlStats); i++) {
+        UsiTwiTransmitByte(&twi_ctx, p_stats[i]);
+        checksum += p_stats[i];
+    }
+    UsiTwiTransmitByte(&twi_ctx, (uint8_t)(start_timeouts & 0xFF));
+    UsiTwiTransmitByte(&twi_ctx, (uint8_t)((start_timeouts & 0xFF00) >> 8));
+    checksum += (uint8_t)(start_timeouts & 0xFF);
+    checksum += (uint8_t)((start_timeouts & 0xFF00) >> 8);
+    UsiTwiTransmitByte(&twi_ctx, checksum);
+    if (command[1] != 0) {
+        // Clear the counters after reading them
+        uint8_t *p_clear = (uint8_t *)&stats;
+        for (uint8_t i = 0; i < sizeof(TmlStats); i++) {
+            p_clear[i] = 0;
+        }
+        start_timeouts = 0;
+    }
+}
+#endif // ENABLE_STATS
+
+#if USE_TICK_TIMER
+/* ______________
+  |              |
+  |   GetTicks   |
+  |______________|
+*/
+uint16_t GetTicks(void) {
+    // Extend the 8-bit timer 0 to 16 bits by counting its overflows. It has
+    // to be called at least once per timer 0 overflow (every 256 ticks).
+    uint8_t ticks_lsb = TICK_TIMER_CNT;
+    if ((TICK_TIMER_IFR >> TOV0) & true) {
+        TICK_TIMER_IFR = (1 << TOV0);   // Clear the timer overflow flag
+        tick_timer_msb++;
+        ticks_lsb = TICK_TIMER_CNT;     // Read it again, it could have overflowed after the first read
+    }
+    return ((tick_timer_msb << 8) | ticks_lsb);
+}
+#endif // USE_TICK_TIMER
+
+#if ENABLE_TRACE
+/* ____________________
+  |                    |
+  |   Reply_GETTRACE   |
+  |____________________|
+*/
+inline void Reply_GETTRACE(void) {
+    // Reply: ACKTRACE, record count, records (oldest first: ticks LSB, MSB, event, arg) ..., checksum
+    uint8_t records = trace_count;
+    if (records > GETTRACE_MAXRC) {
+        records = GETTRACE_MAXRC;   // The rest are left for the next GETTRACE
+    }
+    uint8_t trace_tail = ((trace_head - trace_count) & TRACE_MASK);
+    uint8_t checksum = records;
+    trace_count -= records;
+    UsiTwiTransmitByte(&twi_ctx, ACKTRACE);
+    UsiTwiTransmitByte(&twi_ctx, records);
+    while (records-- != 0) {
+        const uint8_t *p_record = (const uint8_t *)&trace[trace_tail];
+        for (uint8_t i = 0; i < sizeof(TraceRecord); i++) {
+            UsiTwiTransmitByte(&twi_ctx, p_record[i]);
+            checksum += p_record[i];
+        }
+        trace_tail = ((trace_tail + 1) & TRACE_MASK);
+    }
+    UsiTwiTransmitByte(&twi_ctx, checksum);
+}
+
+/* ________________
+  |                |
+  |   TraceEvent   |
+  |________________|
+*/
+void TraceEvent(const uint8_t event, const uint8_t arg) {
+    // Record an event in the trace ring buffer, overwriting the oldest one when it's full
+    TraceRecord *p_record = &trace[trace_head];
+    p_record->ticks = GetTicks();
+    p_record->event = event;
+    p_record->arg = arg;
+    trace_head = ((trace_head + 1) & TRACE_MASK);
+    if (trace_count < TRACE_SIZE) {
+        trace_count++;
+    }
+}
+#endif // ENABLE_TRACE
+
+#if CMD_BUSTEST
+/* ____________________
+  |                    |
+  |   Reply_ECHOTEST   |
+  |____________________|
+*/
+inline void Reply_ECHOTEST(const uint8_t *command) {
+    // Command: ECHOTEST, payload length, payload ..., checksum
+    // Reply: ACKECHOT, payload ..., checksum, byte count LSB, MSB, error count LSB, MSB
+    BusTestCount *p_count = &bus_test[BT_ECHO];
+    const uint8_t data_len = command[1];
+    UsiTwiTransmitByte(&twi_ctx, ACKECHOT);
+    if (data_len == 0) {
+        p_count->bytes = p_count->errors = 0;           // An empty payload resets the test counters
+    } else if (data_len > ECHOTEST_MAXLN) {
+        p_count->errors++;
+    } else {
+        uint8_t checksum = 0;
+        for (uint8_t i = 2; i < data_len + 2; i++) {
+            UsiTwiTransmitByte(&twi_ctx, command[i]);             // Return the payload as received
+            checksum += command[i];
+        }
+        UsiTwiTransmitByte(&twi_ctx, checksum);
+        p_count->bytes += data_len;
+        if (checksum != command[data_len + 2]) {
+            p_count->errors++;
+        }
+    }
+    TransmitBusTestCount(p_count);
+}
+
+/* ____________________
+  |                    |
+  |   Reply_SINKTEST   |
+  |____________________|
+*/
+inline void Reply_SINKTEST(const uint8_t *command) {
+    // Command: SINKTEST, payload length, payload ..., checksum
+    // Reply: ACKSINKT, byte count LSB, MSB, error count LSB, MSB
+    BusTestCount *p_count = &bus_test[BT_SINK];
+    const uint8_t data_len = command[1];
+    UsiTwiTransmitByte(&twi_ctx, ACKSINKT);
+    if (data_len == 0) {
+        p_count->bytes = p_count->errors = 0;           // An empty payload resets the test counters
+    } else if (data_len > SINKTEST_MAXLN) {
+        p_count->errors++;
+    } else {
+        uint8_t checksum = 0;
+        for (uint8_t i = 2; i < data_len + 2; i++) {
+            checksum += command[i];                     // Discard the payload, just check it
+        }
+        p_count->bytes += data_len;
+        if (checksum != command[data_len + 2]) {
+            p_count->errors++;
+        }
+    }
+    TransmitBusTestCount(p_count);
+}
+
+/* ____________________
+  |                    |
+  |   Reply_SRCETEST   |
+  |____________________|
+*/
+inline void Reply_SRCETEST(const uint8_t *command) {
+    // Command: SRCETEST, payload length, pattern seed
+    // Reply: ACKSRCET, pattern ..., checksum, byte count LSB, MSB, error count LSB, MSB
+    BusTestCount *p_count = &bus_test[BT_SOURCE];
+    const uint8_t data_len = command[1];
+    UsiTwiTransmitByte(&twi_ctx, ACKSRCET);
+    if (data_len == 0) {
+        p_count->bytes = p_count->errors = 0;           // An empty payload resets the test counters
+    } else if (data_len > SRCETEST_MAXLN) {
+        p_count->errors++;
+    } else {
+        uint8_t checksum = 0;
+        uint8_t pattern = command[2];
+        for (uint8_t i = 0; i < data_len; i++) {
+            UsiTwiTransmitByte(&twi_ctx, pattern);                // Pattern: seed, seed + 1, seed + 2 ...
+            checksum += pattern++;
+        }
+        UsiTwiTransmitByte(&twi_ctx, checksum);
+        p_count->bytes += data_len;
+    }
+    TransmitBusTestCount(p_count);
+}
+
+/* __________________________
+  |                          |
+  |   TransmitBusTestCount   |
+  |__________________________|
+*/
+void TransmitBusTestCount(BusTestCount *p_count) {
+    UsiTwiTransmitByte(&twi_ctx, (uint8_t)(p_count->bytes & 0xFF));
+    UsiTwiTransmitByte(&twi_ctx, (uint8_t)((p_count->bytes & 0xFF00) >> 8));
+    UsiTwiTransmitByte(&twi_ctx, (uint8_t)(p_count->errors & 0xFF));
+    UsiTwiTransmitByte(&twi_ctx, (uint8_t)((p_count->errors & 0xFF00) >> 8));
+}
+#endif // CMD_BUSTEST
+
+/* ___________________
+  |                   |
+  |   TransmitReply   |
+  |___________________|
+*/
+void TransmitReply(const uint8_t *reply, const uint8_t reply_len) {
+    // Shared by all the fixed-length replies: a single copy of the loop is smaller than one per reply
+    for (uint8_t i = 0; i < reply_len; i++) {
+        UsiTwiTransmitByte(&twi_ctx, reply[i]);
+    }
+}
+
 /* ____________________
   |                    |
   |   ResetPrescaler   |
@@ -678,286 +1661,92 @@ inline void RestorePrescaler(void) {
     CLKPR = ((1 << CLKPS1) | (1 << CLKPS0));  // Clock division factor 8 (0011)
 }
 
-/////////////////////////////////////////////////////////////////////////////
-////////////         USI TWI DRIVER CODE BELOW THIS LINE         ////////////
-/////////////////////////////////////////////////////////////////////////////
-
-/* ___________________________
-  |                           |
-  | USI TWI byte transmission |
-  |___________________________|
-*/
-void UsiTwiTransmitByte(const uint8_t data_byte) {
-    tx_head = ((tx_head + 1) & TWI_TX_BUFFER_MASK);  // Update the TX buffer index
-    tx_buffer[tx_head] = data_byte;  // Write the data byte into the TX buffer
-}
-
-/* _______________________________
-  |                               |
-  | USI TWI driver initialization |
-  |_______________________________|
-*/
-inline void UsiTwiDriverInit(void) {
-    // Initialize USI for TWI Slave mode.
-    tx_tail = tx_head = 0;                  // Flush TWI TX buffers
-    rx_tail = rx_head = rx_byte_count = 0;  // Flush TWI RX buffers
-    SET_USI_SDA_AND_SCL_AS_OUTPUT();        // Set SCL and SDA as output
-    PORT_USI |= (1 << PORT_USI_SDA);        // Set SDA high
-    PORT_USI |= (1 << PORT_USI_SCL);        // Set SCL high
-    SET_USI_SDA_AS_INPUT();                 // Set SDA as input
-    SET_USI_TO_WAIT_FOR_TWI_ADDRESS();      // Wait for TWI start condition and address from master
-}
-
-/* _______________________________________________________
-  |                                                       |
-  | TWI start condition handler (Interrupt-like function) |
-  |_______________________________________________________|
-*/
-inline void TwiStartHandler(void) {
-    SET_USI_SDA_AS_INPUT();  // Float the SDA line
-    // Following a start condition, the device shifts the address present on the TWI bus in and
-    // a 4-bit counter overflow is triggered. Afterward, within the overflow handler, the device
-    // should check whether it has to reply. Prepare the next overflow handler state for it.
-    // Next state -> STATE_CHECK_RECEIVED_ADDRESS
-    device_state = STATE_CHECK_RECEIVED_ADDRESS;
-    while ((PIN_USI & (1 << PORT_USI_SCL)) && (!(PIN_USI & (1 << PORT_USI_SDA)))) {
-        // Wait for SCL to go low to ensure the start condition has completed.
-        // The start detector will hold SCL low.
-    }
-    // If a stop condition arises then leave this function to prevent waiting forever.
-    // Don't use USISR to test for stop condition as in application note AVR312
-    // because the stop condition flag is going to be set from the last TWI sequence.
-    if (!(PIN_USI & (1 << PIN_USI_SDA))) {
-        // ==> Stop condition NOT DETECTED
-        SET_USI_TO_DETECT_TWI_RESTART();
-    } else {
-        // ==> Stop condition DETECTED
-        SET_USI_TO_DETECT_TWI_START();
+/* ____________________
+  |                    |
+  |   ProcessCommand   |
+  |____________________|
+*/
+inline void ProcessCommand(MemPack *p_mem_pack) {
+    // The command starts at the beginning of the RX buffer, it's processed in place, then the buffer is flushed
+    TRACE_EVENT(TR_COMMAND, rx_buffer[0]);
+    PROBE_ON(PROBE_TWI_PIN);
+    ReceiveEvent(rx_buffer, p_mem_pack);
+    PROBE_OFF(PROBE_TWI_PIN);
+    twi_ctx.rx_head = twi_ctx.rx_tail = twi_ctx.rx_byte_count = 0;
+}
+
+#if (ENABLE_STATS || ENABLE_TRACE)
+/* _________________
+  |                 |
+  |   LogTwiEvent   |
+  |_________________|
+*/
+inline void LogTwiEvent(const uint8_t twi_event) {
+    // The driver doesn't know about the bootloader counters and trace: update them from its events
+    switch (twi_event) {
+        case TWI_EV_START: {
+            TRACE_EVENT(TR_START, 0);
+            break;
+        }
+        case TWI_EV_START_TMOUT: {
+#if ENABLE_STATS
+            start_timeouts++;
+#endif // ENABLE_STATS
+            TRACE_EVENT(TR_START_TMOUT, 0);
+            break;
+        }
+        case TWI_EV_ADDR_MISMATCH: {
+            STATS_COUNT(addr_mismatches);
+            break;
+        }
+        case TWI_EV_WRITE:
+        case TWI_EV_READ: {
+            STATS_COUNT(transactions);
+            TRACE_EVENT(TR_ADDRESS, ((TWI_ADDR << 1) | (twi_event == TWI_EV_READ)));
+            break;
+        }
+        case TWI_EV_RX_BYTE: {
+            STATS_COUNT(rx_bytes);
+            break;
+        }
+        case TWI_EV_TX_BYTE: {
+            STATS_COUNT(tx_bytes);
+            break;
+        }
+        case TWI_EV_REPLY_DONE: {
+            TRACE_EVENT(TR_REPLY, 0);
+            break;
+        }
     }
-    // Read the address present on the TWI bus
-    SET_USI_TO_SHIFT_8_ADDRESS_BITS();
 }
+#endif // ENABLE_STATS || ENABLE_TRACE
 
+#if USI_STOP_DETECT
 /* ______________________________________________________
   |                                                      |
-  | USI 4-bit overflow handler (Interrupt-like function) |
+  | USI TWI stop condition handler (Interrupt-like func) |
   |______________________________________________________|
 */
-inline bool UsiOverflowHandler(MemPack *p_mem_pack) {
-    switch (device_state) {
-        // If the address received after the start condition matches this device or is
-        // a general call, reply ACK and check whether it should send or receive data.
-        // Otherwise, set USI to wait for the next start condition and address.
-        case STATE_CHECK_RECEIVED_ADDRESS: {
-            if ((USIDR == 0) || ((USIDR >> 1) == TWI_ADDR)) {
-                if (USIDR & 0x01) {  // If data register low-order bit = 1, start the send data mode
-                    // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
-                    // Address bit 0 is = 1, processing the received command & sending data   >>
-                    uint8_t command_size = rx_byte_count;                //                    >>
-                    static uint8_t command[MST_PACKET_SIZE * 2];         //  Read the receive   >>
-                    for (uint8_t i = 0; i < command_size; i++) {         //  buffer, then call   >>
-                        rx_tail = ((rx_tail + 1) & TWI_RX_BUFFER_MASK);  //  "ReceiveEvent" to    >>
-                        rx_byte_count--;                                 //  process the received >>
-                        command[i] = rx_buffer[rx_tail];                 //  command and send    >>
-                    }                                                    //  the reply.         >>
-                    ReceiveEvent(command, p_mem_pack);                   //                    >>
-                    //                                                                        >>
-                    // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
-                    // Next state -> STATE_SEND_DATA_BYTE
-                    device_state = STATE_SEND_DATA_BYTE;
-                } else {  // If data register low-order bit = 0, start the receive data mode
-                    // Next state -> STATE_RECEIVE_DATA_BYTE
-                    device_state = STATE_RECEIVE_DATA_BYTE;
-                }
-                SET_USI_TO_SEND_ACK();
-            } else {
-                SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
-            }
-            return false;
-        }
-        // Send data mode:
-        //================
-        // 3) Check whether the acknowledge bit received from the master is ACK or
-        // NACK. If ACK (low), just continue to STATE_SEND_DATA_BYTE without break. If NACK (high)
-        // the transmission is complete. Wait for a new start condition and TWI address.
-        case STATE_CHECK_RECEIVED_ACK: {
-            if (USIDR) {  // NACK - handshake complete ...
-                SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
-                // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
-                //                                                                  >>
-                return true;  // Enable slow operations in main!                     >>
-                //                                                                  >>
-                // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
-            }
-            // Just drop straight into STATE_SEND_DATA_BYTE (no break) ...
-        }
-        // 1) Copy data from TX buffer to USIDR and set USI to shift 8 bits out. When the 4-bit
-        // counter overflows, it means that a byte has been transmitted, so this device is ready
-        // to transmit again or wait for a new start condition and address on the bus.
-        case STATE_SEND_DATA_BYTE: {
-            if (tx_head != tx_tail) {
-                // If the TX buffer has data, copy the next byte to USI data register for sending
-                tx_tail = ((tx_tail + 1) & TWI_TX_BUFFER_MASK);
-                USIDR = tx_buffer[tx_tail];
-            } else {
-                // If the TX buffer is empty ...
-                SET_USI_TO_RECEIVE_ACK();  // This might be necessary (http://www.avrfreaks.net/index.php?name=PNphpBB2&file=viewtopic&p=805227#805227)
-                SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
-                return false;
-            }
-            // Next state -> STATE_RECEIVE_ACK_AFTER_SENDING_DATA
-            device_state = STATE_RECEIVE_ACK_AFTER_SENDING_DATA;
-            SET_USI_TO_SEND_BYTE();
-            return false;
-        }
-        // 2) Set USI to receive an acknowledge bit reply from master
-        case STATE_RECEIVE_ACK_AFTER_SENDING_DATA: {
-            // Next state -> STATE_CHECK_RECEIVED_ACK
-            device_state = STATE_CHECK_RECEIVED_ACK;
-            SET_USI_TO_RECEIVE_ACK();
-            return false;
-        }
-        // Receive data mode:
-        // ==================
-        // 1) Set the USI to shift 8 bits in. When the 4-bit counter overflows,
-        // it means that a byte has been received and this device should process it
-        // on the next overflow state (STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK).
-        case STATE_RECEIVE_DATA_BYTE: {
-            // Next state -> STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK
-            device_state = STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK;
-            SET_USI_TO_RECEIVE_BYTE();
-            return false;
-        }
-        // 2) Copy the received byte from USIDR to RX buffer and send ACK. After the
-        // counter overflows, return to the previous state (STATE_RECEIVE_DATA_BYTE).
-        // This mode's cycle should end when a stop condition is detected on the bus.
-        case STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK: {
-            // Put data into buffer
-            rx_head = ((rx_head + 1) & TWI_RX_BUFFER_MASK);
-            rx_buffer[rx_head] = USIDR;
-            rx_byte_count++;            
-            // Next state -> STATE_RECEIVE_DATA_BYTE
-            device_state = STATE_RECEIVE_DATA_BYTE;
-            SET_USI_TO_SEND_ACK();
-            return false;
-        }
-    }
-    // Clear the 4-bit counter overflow flag in USI status register after processing each
-    // overflow state to allow detecting new interrupts that take this device to next states.
-    USISR |= (1 << USI_OVERFLOW_FLAG);
-    return false;
-}
-
-// ----------------------------------------------------------------------------
-// USI TWI basic operations functions
-// ----------------------------------------------------------------------------
-// Set USI to detect start and shift 7 address bits + 1 direction bit in.
-inline void SET_USI_TO_WAIT_FOR_TWI_ADDRESS(void) {
-    SET_USI_TO_DETECT_TWI_START();   // Detect start condition
-    SET_USI_TO_SHIFT_8_DATA_BITS();  // Shift 8 bits
-}
-// ............................................................................
-// Set USI to send a byte.
-inline void SET_USI_TO_SEND_BYTE(void) {
-    SET_USI_SDA_AS_OUTPUT();         // Drive the SDA line
-    SET_USI_TO_SHIFT_8_DATA_BITS();  // Shift 8 bits
-}
-// ............................................................................
-// Set USI to receive a byte.
-inline void SET_USI_TO_RECEIVE_BYTE(void) {
-    SET_USI_SDA_AS_INPUT();          // Float the SDA line
-    SET_USI_TO_SHIFT_8_DATA_BITS();  // Shift 8 bits
-}
-// ............................................................................
-// Set USI to send an ACK bit.
-inline void SET_USI_TO_SEND_ACK(void) {
-    USIDR = 0;                     // Clear the USI data register
-    SET_USI_SDA_AS_OUTPUT();       // Drive the SDA line
-    SET_USI_TO_SHIFT_1_ACK_BIT();  // Shift 1 bit
-}
-// ............................................................................
-// Set USI to receive an ACK bit.
-inline void SET_USI_TO_RECEIVE_ACK(void) {
-    USIDR = 0;                     // Clear the USI data register
-    SET_USI_SDA_AS_INPUT();        // Float the SDA line
-    SET_USI_TO_SHIFT_1_ACK_BIT();  // Shift 1 bit
-}
-
-// ----------------------------------------------------------------------------
-// USI register configurations
-// ----------------------------------------------------------------------------
-// Configure USI control register to detect start condition.
-inline void SET_USI_TO_DETECT_TWI_START(void) {
-    USICR = (1 << TWI_START_COND_INT) | (0 << USI_OVERFLOW_INT) |  // Enable start condition interrupt, disable overflow interrupt
-            (1 << USIWM1) | (0 << USIWM0) |                        // Set USI in Two-wire mode, don't hold SCL low when the 4-bit counter overflows
-            (1 << USICS1) | (0 << USICS0) | (0 << USICLK) |        // Clock Source = External (positive edge) for data register, External (both edges) for 4-Bit counter
-            (0 << USITC);                                          // No toggle clock-port pin (SCL)
-}
-// ............................................................................
-// Configure USI control register to detect RESTART.
-inline void SET_USI_TO_DETECT_TWI_RESTART(void) {
-    USICR = (1 << TWI_START_COND_INT) | (1 << USI_OVERFLOW_INT) |  // Enable start condition interrupt, disable overflow interrupt
-            (1 << USIWM1) | (1 << USIWM0) |                        // Set USI in Two-wire mode, hold SCL low when the 4-bit counter overflows
-            (1 << USICS1) | (0 << USICS0) | (0 << USICLK) |        // Clock Source = External (positive edge) for data register, External (both edges) for 4-Bit counter
-            (0 << USITC);                                          // No toggle clock-port pin (SCL)
-}
-// ............................................................................
-// Clear all USI status register interrupt flags to prepare for new start conditions.
-inline void SET_USI_TO_SHIFT_8_ADDRESS_BITS(void) {
-    USISR = (1 << TWI_START_COND_FLAG) |
-            (1 << USI_OVERFLOW_FLAG) |
-            (1 << TWI_STOP_COND_FLAG) |
-            (1 << TWI_COLLISION_FLAG) |
-            (0x0 << USICNT0);  // Reset status register 4-bit counter to shift 8 bits (data byte to be received)
-}
-// ............................................................................
-// Clear all USI status register interrupt flags, except start condition.
-inline void SET_USI_TO_SHIFT_8_DATA_BITS(void) {
-    USISR = (0 << TWI_START_COND_FLAG) |
-            (1 << USI_OVERFLOW_FLAG) |
-            (1 << TWI_STOP_COND_FLAG) |
-            (1 << TWI_COLLISION_FLAG) |
-            (0x0 << USICNT0);  // Set status register 4-bit counter to shift 8 bits
-}
-// ............................................................................
-// Clear all USI status register interrupt flags, except start condition.
-inline void SET_USI_TO_SHIFT_1_ACK_BIT(void) {
-    USISR = (0 << TWI_START_COND_FLAG) |
-            (1 << USI_OVERFLOW_FLAG) |
-            (1 << TWI_STOP_COND_FLAG) |
-            (1 << TWI_COLLISION_FLAG) |
-            (0x0E << USICNT0);  // Set status register 4-bit counter to shift 1 bit
-}
-
-// ----------------------------------------------------------------------------
-// GPIO TWI direction settings
-// ----------------------------------------------------------------------------
-// Drive the data line
-inline void SET_USI_SDA_AS_OUTPUT(void) {
-    DDR_USI |= (1 << PORT_USI_SDA);
-}
-// ............................................................................
-// Float the data line
-inline void SET_USI_SDA_AS_INPUT(void) {
-    DDR_USI &= ~(1 << PORT_USI_SDA);
-}
-// ............................................................................
-// Drive the clock line
-inline void SET_USI_SCL_AS_OUTPUT(void) {
-    DDR_USI |= (1 << PORT_USI_SCL);
-}
-// ............................................................................
-// Float the clock line
-inline void SET_USI_SCL_AS_INPUT(void) {
-    DDR_USI &= ~(1 << PORT_USI_SCL);
-}
-// ............................................................................
-// Drive the data and clock lines
-inline void SET_USI_SDA_AND_SCL_AS_OUTPUT(void) {
-    DDR_USI |= (1 << PORT_USI_SDA) | (1 << PORT_USI_SCL);
-}
-// ............................................................................
-// Float the data and clock lines
-inline void SET_USI_SDA_AND_SCL_AS_INPUT(void) {
-    DDR_USI &= ~((1 << PORT_USI_SDA) | (1 << PORT_USI_SCL));
+inline bool UsiStopHandler(MemPack *p_mem_pack) {
+    // The master wrote a command and released the bus: wait for the next start condition and
+    // process the command now. Its reply, if any, is sent when the master reads it later.
+    SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+    twi_ctx.device_state = STATE_CHECK_RECEIVED_ADDRESS;
+    if (twi_ctx.rx_byte_count == 0) {
+        return false;  // Address-only write (bus probe): nothing to process
+    }
+    TRACE_EVENT(TR_STOP, rx_buffer[0]);
+    twi_ctx.tx_head = twi_ctx.tx_tail = twi_ctx.tx_byte_count = 0;  // A new command discards a reply that was never read
+    ReceiveEvent(rx_buffer, p_mem_pack);
+    twi_ctx.rx_head = twi_ctx.rx_tail = twi_ctx.rx_byte_count = 0;
+    // The master may never read the reply (e.g. a write-only WRITPAGE or EXITTMNL): run the slow
+    // operations now. The reply stays in the TX buffer, a later read gets it after they end.
+    return true;
 }
+#endif // USI_STOP_DETECT
+
+#if !(TWI_APP_API)
+// USI TWI driver, inlined in the main loop (with TWI_APP_API it's built in its own translation unit)
+#define TWI_DRIVER_IMPL
+#include "timonel-usi.c"
+#endif // !TWI_APP_API
@@ -24,23 +24,101 @@
 #include <avr/boot.h>
 #include <avr/eeprom.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <avr/wdt.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <util/crc16.h>
 
 #include "../../nb-twi-cmd/src/nb-twi-cmd.h"
 
+// Flash memory page index type: 16 bits on devices with pages bigger than 64 bytes,
+// so an extra WRITPAGE frame can't wrap the index around to the start of the page
+#if (SPM_PAGESIZE > 64)
+typedef uint16_t page_ix_t;
+#else
+typedef uint8_t page_ix_t;
+#endif /* SPM_PAGESIZE > 64 */
+
 // Memory management and flags data pack
 typedef struct m_pack {
     uint16_t page_addr;  // Flash memory page address
-    uint8_t page_ix;     // Flash memory page index
-    uint8_t flags;       // Bit: 8, 7, 6, 5: not used; 4: exit; 3: delete app; 2, 1: initialized
+    page_ix_t page_ix;   // Flash memory page index
+    uint8_t flags;       // Bit: 8: erase range; 7: patch page; 6: page error; 5: reset journal; 4: exit; 3: delete app; 2, 1: initialized
 #if AUTO_PAGE_ADDR
     uint8_t app_reset_lsb;  // Application first byte: reset vector LSB
     uint8_t app_reset_msb;  // Application second byte: reset vector MSB
 #endif                      // AUTO_PAGE_ADDR
+#if UPLOAD_JOURNAL
+    uint16_t image_id;      // Identifier of the application image being uploaded
+#endif                      // UPLOAD_JOURNAL
+#if (UPLOAD_JOURNAL || VERIFY_IMAGE)
+    uint16_t upload_crc;    // Running CRC-16 of the application data received
+#endif                      // UPLOAD_JOURNAL || VERIFY_IMAGE
+#if VERIFY_PAGE
+    uint16_t page_sum;      // Sum of the words filled into the temporary page buffer
+#endif                      // VERIFY_PAGE
+#if CMD_PATCHPAGE
+    uint16_t patch_page;    // Base address of the page being patched
+#endif                      // CMD_PATCHPAGE
+#if CMD_ERASERANGE
+    uint16_t erase_page;    // Base address of the first page to erase
+    uint8_t erase_count;    // Amount of pages to erase
+#endif                      // CMD_ERASERANGE
+#if DEFER_TPL_COMMIT
+    bool tpl_commit;        // An application was uploaded, write its trampoline before exiting
+#endif                      // DEFER_TPL_COMMIT
+#if BATCH_WRITES
+    uint16_t batch_frames;  // WRTBATCH frames processed since the last GETBATCH
+    uint16_t batch_sum;     // Rolling sum of the WRTBATCH frames checksums
+    uint8_t batch_status;   // Bit: 2: page verification error; 1: checksum or length error
+#endif                      // BATCH_WRITES
 } MemPack;                  // "Memory pack" structure
 
+// Bootloader statistics counters
+typedef struct tml_stats {
+    uint16_t transactions;     // TWI transactions addressed to this device
+    uint16_t rx_bytes;         // Bytes received
+    uint16_t tx_bytes;         // Bytes transmitted
+    uint16_t checksum_errors;  // WRITPAGE packets with wrong checksum
+    uint16_t unknown_cmds;     // Commands replied with UNKNOWNC
+    uint16_t page_writes;      // Flash pages written
+    uint16_t page_erases;      // Flash pages erased
+    uint16_t addr_mismatches;  // TWI transactions addressed to other devices
+    uint16_t max_loop_ticks;   // Longest main loop iteration, in stats timer ticks
+} TmlStats;                    // "Timonel statistics" structure
+
+// Event trace record
+typedef struct trace_rec {
+    uint16_t ticks;  // Tick timer value when the event happened
+    uint8_t event;   // Event code
+    uint8_t arg;     // Event argument
+} TraceRecord;       // "Trace record" structure
+
+// Bus throughput self-test counters
+typedef struct bt_count {
+    uint16_t bytes;   // Payload bytes moved by the test
+    uint16_t errors;  // Packets with wrong checksum or size
+} BusTestCount;       // "Bus test count" structure
+
+// Upload progress journal (kept at the end of the EEPROM)
+typedef struct u_journal {
+    uint16_t image_id;      // Identifier of the application image being uploaded
+    uint16_t next_page;     // Address of the first page not yet committed to flash
+    uint16_t upload_crc;    // Running CRC-16 of the data committed up to "next_page"
+    uint8_t app_reset_lsb;  // Application first byte: reset vector LSB
+    uint8_t app_reset_msb;  // Application second byte: reset vector MSB
+} UploadJournal;            // "Upload journal" structure
+
+// Application image record (kept in EEPROM, before the upload journal)
+typedef struct i_record {
+    uint16_t image_len;     // Application length, from address 0 to the end of the last page uploaded
+    uint16_t image_crc;     // CRC-16 of the application data, as received from the master
+    uint8_t app_reset_lsb;  // Application first byte: reset vector LSB
+    uint8_t app_reset_msb;  // Application second byte: reset vector MSB
+    uint8_t state;          // IMG_PENDING: not checked yet, IMG_VALID: checked, any other: no valid image
+} ImageRecord;              // "Image record" structure
+
 /* ====== [   The configuration of the next optional features can be checked   ] ====== */
 /* VVVVVV [   from the I2C master by using the GETTMNLV command.               ] VVVVVV */
 /*            NOTE: These values can be set externally as makefile options              */
@@ -127,6 +205,77 @@ typedef struct m_pack {
 /* ^^^^^^ [       End of feature settings shown in the GETTMNLV command.       ] ^^^^^^ */
 /* ====== [       ......................................................       ] ====== */
 
+/* ====== [   The next optional features are not shown in the GETTMNLV reply  ] ====== */
+/* VVVVVV [   feature bytes. NOTE: These values can be set as makefile options ] VVVVVV */
+
+#ifndef UPLOAD_JOURNAL       /* This option keeps an upload progress journal in the last EEPROM    */
+#define UPLOAD_JOURNAL false /* bytes (image ID, next page to write, running CRC) and enables the  */
+#endif /* UPLOAD_JOURNAL */  /* GETRESUM command, which lets the master resume an interrupted      */
+                             /* upload instead of deleting the flash and starting over.            */
+
+#ifndef VERIFY_PAGE         /* This option reads back each page after writing it and compares it   */
+#define VERIFY_PAGE false    /* against the sum of the data filled into the page buffer. Failures   */
+#endif /* VERIFY_PAGE */     /* are reported by replying ERRWTPAG to the next WRITPAGE or EXITTMNL. */
+
+#ifndef CMD_PATCHPAGE        /* This option enables the PATCHPAG command, which overwrites a few    */
+#define CMD_PATCHPAGE false  /* bytes of an application page (e.g. a calibration constant or a      */
+#endif /* CMD_PATCHPAGE */   /* serial number) by rewriting only that page, without a full upload.  */
+
+#ifndef CMD_ERASERANGE       /* This option enables the ERASERNG command, which erases a range of   */
+#define CMD_ERASERANGE false /* application pages as a slow operation, without deleting the whole  */
+#endif /* CMD_ERASERANGE */  /* application or restarting the bootloader.                          */
+
+#ifndef CMD_BUSTEST          /* This option enables the ECHOTEST, SINKTEST and SRCETEST commands,   */
+#define CMD_BUSTEST false    /* which measure the raw TWI link performance with several packet      */
+#endif /* CMD_BUSTEST */     /* sizes and bus speeds. Each test keeps its own byte/error counters.  */
+
+#ifndef ENABLE_STATS         /* This option keeps 16-bit statistics counters (transactions, bytes,  */
+#define ENABLE_STATS false   /* errors, page writes and erases, longest main loop iteration, etc.)  */
+#endif /* ENABLE_STATS */    /* and enables the GETSTATS command to read them. It uses timer 0.     */
+
+#ifndef ENABLE_TRACE         /* This option records timestamped events (start conditions, commands, */
+#define ENABLE_TRACE false   /* replies and slow operations) in a small RAM ring buffer, and enables */
+#endif /* ENABLE_TRACE */    /* the GETTRACE command to drain it. It uses timer 0.                  */
+
+#ifndef DEFER_TPL_COMMIT       /* When AUTO_PAGE_ADDR is enabled, the trampoline page is written only */
+#define DEFER_TPL_COMMIT false /* once, when EXITTMNL is received after an upload, instead of right   */
+#endif /* DEFER_TPL_COMMIT */  /* after page 0. Partially uploaded applications never become runnable. */
+
+#ifndef VERIFY_IMAGE         /* The application is run only if the CRC-16 of its flash contents     */
+#define VERIFY_IMAGE false   /* matches the digest recorded in EEPROM when its upload finished. The */
+#endif /* VERIFY_IMAGE */    /* CRC runs once after each upload, then a "validated" state is kept.  */
+
+#ifndef CMD_GETCAPAB         /* This option enables the GETCAPAB command, which returns the page,   */
+#define CMD_GETCAPAB false   /* packet and buffer sizes, flash and EEPROM sizes, device signature,  */
+#endif /* CMD_GETCAPAB */    /* CPU clock and the additional features, to size the TWI transfers.   */
+
+#ifndef BATCH_WRITES         /* This option enables the WRTBATCH command, a WRITPAGE without reply, */
+#define BATCH_WRITES false   /* and GETBATCH, which returns the frames count, errors and rolling    */
+#endif /* BATCH_WRITES */    /* checksum. The master reads the status once every N frames.          */
+
+#ifndef WRITPAGE_VARLEN       /* WRITPAGE frames carry a length byte after the command: only the     */
+#define WRITPAGE_VARLEN false /* words sent are filled, the rest of the packet is left erased. The   */
+#endif /* WRITPAGE_VARLEN */  /* image tail and 0xFF-only packets don't have to be padded anymore.   */
+
+#ifndef TWI_APP_API          /* This option exposes the bootloader TWI slave driver to applications */
+#define TWI_APP_API false    /* through a versioned jump table at the top of the flash, so they     */
+#endif /* TWI_APP_API */     /* don't have to link their own. See "timonel-twi-api.h".             */
+
+#ifndef USI_STOP_DETECT      /* This option detects the stop condition that ends a master write    */
+#define USI_STOP_DETECT false /* (USIPF) and processes the command right away, instead of waiting   */
+#endif /* USI_STOP_DETECT */ /* for the read address. Write-only commands don't need a read anymore. */
+
+#ifndef USI_IDLE_SLEEP       /* Once initialized, the bootloader sleeps in idle mode between bus    */
+#define USI_IDLE_SLEEP false /* events instead of busy-polling the USI status register. The enabled */
+#endif /* USI_IDLE_SLEEP */  /* USI flags wake the CPU up with interrupts disabled (no vectors).    */
+
+#ifndef ENABLE_PROBES        /* This option drives spare GPIO pins high while the start handler,    */
+#define ENABLE_PROBES false  /* the overflow handler states and the flash operations run, to time   */
+#endif /* ENABLE_PROBES */   /* them against SDA/SCL with a logic analyzer. NOT FOR PRODUCTION!     */
+
+/* ^^^^^^ [             End of additional optional feature settings.           ] ^^^^^^ */
+/* ====== [       ......................................................       ] ====== */
+
 /* ------------------------------------------------------------------------------------ */
 /* ---    Timonel internal configuration. Do not change anything below this line    --- */
 /* ---    unless you know how to customize or adapt it to another microcontroller.  --- */
@@ -134,7 +283,9 @@ typedef struct m_pack {
 /* ------------------------------------------------------------------------------------ */
 
 // TWI commands Xmit packet size
-#define MST_PACKET_SIZE 64 /* Master-to-slave Xmit packet size: always even values, min=2, max=64 */
+#ifndef MST_PACKET_SIZE     /* Master-to-slave Xmit packet size: even values, min=2, max=SPM_PAGESIZE */
+#define MST_PACKET_SIZE 64  /* On devices with 128-byte pages (ATtiny87/167), setting it to 128 in   */
+#endif /* MST_PACKET_SIZE */ /* the makefile writes a whole page per WRITPAGE command.               */
 #define SLV_PACKET_SIZE 64 /* Slave-to-master Xmit packet size: always even values, min=2, max=64 */
 
 // Led UI settings
@@ -146,6 +297,48 @@ typedef struct m_pack {
 #define LED_UI_DDR DDRB   /* Activity monitor led data register.                                 */
 #define LED_UI_PORT PORTB /* Activity monitor led port.                                          */
 
+// GPIO probe settings
+#if defined(__AVR_ATtiny24__) | \
+    defined(__AVR_ATtiny44__) | \
+    defined(__AVR_ATtiny84__)
+#define PROBE_DDR DDRA        /* GPIO probes data direction register (ATtinyX4: USI on PORTA).       */
+#define PROBE_PORT PORTA      /* GPIO probes port.                                                   */
+#define PROBE_TWI_DFT PA1     /* Default probe pins ...                                              */
+#define PROBE_OVF_DFT PA2
+#define PROBE_SPM_DFT PA3
+#define PROBE_PIN_MAX PA7     /* Highest pin available for the probes.                               */
+#elif defined(__AVR_ATtiny43U__)
+#define PROBE_DDR DDRB        /* GPIO probes data direction register (ATtiny43U: USI on PB4 and PB6).*/
+#define PROBE_PORT PORTB      /* GPIO probes port.                                                   */
+#define PROBE_TWI_DFT PB3     /* Default probe pins ...                                              */
+#define PROBE_OVF_DFT PB2
+#define PROBE_SPM_DFT PB1
+#define PROBE_PIN_MAX PB7     /* Highest pin available for the probes.                               */
+#else
+#define PROBE_DDR DDRB        /* GPIO probes data direction register.                                */
+#define PROBE_PORT PORTB      /* GPIO probes port.                                                   */
+#define PROBE_TWI_DFT PB3     /* Default probe pins ...                                              */
+#define PROBE_OVF_DFT PB4
+#define PROBE_SPM_DFT PB1
+#if defined(__AVR_ATtiny25__) | \
+    defined(__AVR_ATtiny45__) | \
+    defined(__AVR_ATtiny85__)
+#define PROBE_PIN_MAX PB4     /* Highest pin available for the probes (ATtinyX5: PB5 is RESET).     */
+#else
+#define PROBE_PIN_MAX PB7     /* Highest pin available for the probes.                               */
+#endif /* ATtinyX5 */
+#endif /* ATtinyX4 */
+#ifndef PROBE_TWI_PIN                 /* GPIO pin driven high while the start handler or the receive event   */
+#define PROBE_TWI_PIN PROBE_TWI_DFT   /* (command dispatch) run. The dispatch happens inside an overflow     */
+                                      /* handler pulse, the start handler never does.                        */
+#endif /* PROBE_TWI_PIN */
+#ifndef PROBE_OVF_PIN                 /* GPIO pin driven high while the overflow handler runs. It pulses     */
+#define PROBE_OVF_PIN PROBE_OVF_DFT   /* once per USI state, so it also shows the clock stretching time.     */
+#endif /* PROBE_OVF_PIN */
+#ifndef PROBE_SPM_PIN                 /* GPIO pin driven high while a flash page is erased or written.       */
+#define PROBE_SPM_PIN PROBE_SPM_DFT   /* NOTE: It can't be the same pin as LED_UI_PIN if ENABLE_LED_UI is on.*/
+#endif /* PROBE_SPM_PIN */
+
 // Timonel ID characters
 #define ID_CHAR_1 78  /* N */
 #define ID_CHAR_2 66  /* B */
@@ -157,10 +350,10 @@ typedef struct m_pack {
 #define FL_INIT_2 1    /* Flag bit 2 (2)  : Two-step initialization STEP 2 */
 #define FL_DEL_FLASH 2 /* Flag bit 3 (4)  : Delete flash memory            */
 #define FL_EXIT_TML 3  /* Flag bit 4 (8)  : Exit Timonel & run application */
-#define FL_BIT_5 4     /* Flag bit 5 (16) : Not used */
-#define FL_BIT_6 5     /* Flag bit 6 (32) : Not used */
-#define FL_BIT_7 6     /* Flag bit 7 (64) : Not used */
-#define FL_BIT_8 7     /* Flag bit 8 (128): Not used */
+#define FL_RST_JRNL 4  /* Flag bit 5 (16) : Reset upload journal          */
+#define FL_PAGE_ERR 5  /* Flag bit 6 (32) : Page write verification failed */
+#define FL_PATCH_PG 6  /* Flag bit 7 (64) : Write the patched page         */
+#define FL_ERASE_RNG 7 /* Flag bit 8 (128): Erase a range of pages        */
 
 // Length constants for command replies
 #define GETTMNLV_RPLYLN 12 /* GETTMNLV command reply length */
@@ -169,6 +362,84 @@ typedef struct m_pack {
 #define READDEVS_RPLYLN 10 /* READDEVS command reply length */
 #define WRITEEPR_RPLYLN 2  /* WRITEEPR command reply length */
 #define READEEPR_RPLYLN 3  /* READEEPR command reply length */
+#define GETRESUM_RPLYLN 6  /* GETRESUM command reply length */
+#define PATCHPAG_RPLYLN 2  /* PATCHPAG command reply length */
+#define ERASERNG_RPLYLN 2  /* ERASERNG command reply length */
+#define GETCAPAB_RPLYLN 24 /* GETCAPAB command reply length */
+#define GETBATCH_RPLYLN 7  /* GETBATCH command reply length */
+
+// Bus self-test payload sizes: ack + payload + checksum + byte count + error count
+#define ECHOTEST_MAXLN (SLV_PACKET_SIZE - 6) /* Max bytes returned by ECHOTEST */
+#define SINKTEST_MAXLN MST_PACKET_SIZE       /* Max bytes accepted by SINKTEST */
+#define SRCETEST_MAXLN (SLV_PACKET_SIZE - 6) /* Max bytes sent by SRCETEST     */
+#define BT_ECHO 0                            /* Echo test counters index       */
+#define BT_SINK 1                            /* Sink test counters index       */
+#define BT_SOURCE 2                          /* Source test counters index     */
+
+// PATCHPAG data size: command, address LSB, address MSB, length, data ..., checksum
+#define PATCHPAG_MAXLN (MST_PACKET_SIZE - 3) /* Max bytes patched per PATCHPAG command */
+
+// Timonel commands not included in "nb-twi-cmd.h" yet
+#ifndef GETRESUM
+#define GETRESUM 0x90 /* Command: Get the upload resume point from the journal */
+#define ACKRESUM 0x6F /* Acknowledge: GETRESUM                                 */
+#endif /* GETRESUM */
+#ifndef PATCHPAG
+#define PATCHPAG 0x91 /* Command: Overwrite some bytes of a flash memory page  */
+#define ACKPATCH 0x6E /* Acknowledge: PATCHPAG                                 */
+#endif /* PATCHPAG */
+#ifndef ERASERNG
+#define ERASERNG 0x92 /* Command: Erase a range of flash memory pages          */
+#define ACKERASR 0x6D /* Acknowledge: ERASERNG                                 */
+#endif /* ERASERNG */
+#ifndef ECHOTEST
+#define ECHOTEST 0x93 /* Command: Bus test, return the received payload        */
+#define ACKECHOT 0x6C /* Acknowledge: ECHOTEST                                 */
+#endif /* ECHOTEST */
+#ifndef SINKTEST
+#define SINKTEST 0x94 /* Command: Bus test, discard the received payload       */
+#define ACKSINKT 0x6B /* Acknowledge: SINKTEST                                 */
+#endif /* SINKTEST */
+#ifndef SRCETEST
+#define SRCETEST 0x95 /* Command: Bus test, send a payload with a test pattern */
+#define ACKSRCET 0x6A /* Acknowledge: SRCETEST                                 */
+#endif /* SRCETEST */
+#ifndef GETSTATS
+#define GETSTATS 0x96 /* Command: Get the bootloader statistics counters       */
+#define ACKSTATS 0x69 /* Acknowledge: GETSTATS                                 */
+#endif /* GETSTATS */
+#ifndef GETTRACE
+#define GETTRACE 0x97 /* Command: Drain the event trace ring buffer            */
+#define ACKTRACE 0x68 /* Acknowledge: GETTRACE                                 */
+#endif /* GETTRACE */
+#ifndef GETCAPAB
+#define GETCAPAB 0x98 /* Command: Get the transfer geometry and clock figures */
+#define ACKCAPAB 0x67 /* Acknowledge: GETCAPAB                                 */
+#endif /* GETCAPAB */
+#ifndef WRTBATCH
+#define WRTBATCH 0x99 /* Command: Write page data without reply (batch mode)  */
+#endif /* WRTBATCH */
+#ifndef GETBATCH
+#define GETBATCH 0x9A /* Command: Get and clear the batch writes status       */
+#define ACKBATCH 0x65 /* Acknowledge: GETBATCH                                 */
+#endif /* GETBATCH */
+#ifndef ERRWTPAG
+#define ERRWTPAG 0xF0 /* Error: The last page written doesn't match its data  */
+#endif /* ERRWTPAG */
+
+// Batch writes status bits
+#define BT_ERR_CHECKSUM 0 /* Status bit 1 (1): A frame had a wrong checksum or length */
+#define BT_ERR_PAGE 1     /* Status bit 2 (2): A page verification failed             */
+
+// Upload journal location
+#define JOURNAL_EEPROM_ADDR (E2END + 1 - sizeof(UploadJournal)) /* Journal at the end of the EEPROM */
+#define JOURNAL_NO_IMAGE 0xFFFF                                 /* Erased EEPROM image identifier  */
+
+// Application image record location and states
+#define IMAGE_EEPROM_ADDR (JOURNAL_EEPROM_ADDR - sizeof(ImageRecord)) /* Record just before the journal  */
+#define IMG_NONE 0xFF                                                 /* No valid image (erased EEPROM)  */
+#define IMG_PENDING 0x50                                              /* Image recorded, not checked yet */
+#define IMG_VALID 0x56                                                /* Image checked against its CRC   */
 
 // Memory page definitions
 #define RESET_PAGE 0 /* Interrupt vector table address start location. */
@@ -206,6 +477,89 @@ typedef struct m_pack {
               "r"((uint8_t)(BOOT_TEMP_BUFF_ERASE))); \
     }))
 
+// Statistics counters update macro
+#if ENABLE_STATS
+#define STATS_COUNT(counter) (stats.counter++)
+#else
+#define STATS_COUNT(counter)
+#endif /* ENABLE_STATS */
+
+// Event trace macro
+#if ENABLE_TRACE
+#define TRACE_EVENT(event, arg) TraceEvent(event, arg)
+#else
+#define TRACE_EVENT(event, arg)
+#endif /* ENABLE_TRACE */
+
+// GPIO probe macros (single sbi/cbi instructions, 2 cycles each)
+#if ENABLE_PROBES
+#define PROBE_ON(pin) (PROBE_PORT |= (1 << (pin)))
+#define PROBE_OFF(pin) (PROBE_PORT &= ~(1 << (pin)))
+#else
+#define PROBE_ON(pin)
+#define PROBE_OFF(pin)
+#endif /* ENABLE_PROBES */
+
+#if (ENABLE_PROBES && ENABLE_LED_UI && (PROBE_SPM_PIN == LED_UI_PIN))
+#error PROBE_SPM_PIN and LED_UI_PIN are the same pin, please disable ENABLE_LED_UI or move the probe
+#endif /* ENABLE_PROBES && ENABLE_LED_UI */
+
+// Event trace codes
+#define TR_START 1        /* Start condition (arg: 0)                            */
+#define TR_ADDRESS 2      /* Address match (arg: address byte, bit 0 = read)     */
+#define TR_COMMAND 3      /* Command received (arg: command code)                */
+#define TR_REPLY 4        /* Reply read by the master (arg: 0)                   */
+#define TR_SLOW_OPS 5     /* Slow operations begin (arg: flags)                  */
+#define TR_SLOW_OPS_END 6 /* Slow operations end (arg: flags)                    */
+#define TR_START_TMOUT 7  /* Start condition handler timeout (arg: 0)            */
+#define TR_STOP 8         /* Stop condition after a master write (arg: command)  */
+
+// Event trace ring buffer size. Allowed sizes: 2, 4, 8, 16, 32 or 64 records (4 bytes each)
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 16
+#endif /* TRACE_SIZE */
+
+#define TRACE_MASK (TRACE_SIZE - 1)
+
+#if (TRACE_SIZE & TRACE_MASK)
+#error Event trace size is not a power of 2
+#endif /* TRACE_SIZE & TRACE_MASK */
+
+#define GETTRACE_MAXRC ((SLV_PACKET_SIZE - 3) / sizeof(TraceRecord)) /* Max records per GETTRACE reply */
+
+// Tick timer: timer 0 running at CPU clock / 1024, used by the statistics and the event trace
+#define USE_TICK_TIMER (ENABLE_STATS || ENABLE_TRACE)
+#define TICK_TIMER_CTL TCCR0B                          /* Timer 0 control register (clock select)  */
+#if defined(__AVR_ATtiny87__) | \
+    defined(__AVR_ATtiny167__)
+#define TICK_TIMER_CLK_SEL ((1 << CS02) | (1 << CS01) | (1 << CS00)) /* CPU clock / 1024 (ATtinyX7) */
+#else
+#define TICK_TIMER_CLK_SEL ((1 << CS02) | (1 << CS00)) /* Clock select: CPU clock / 1024           */
+#endif /* ATtinyX7 */
+#if defined(TCNT0L)
+#define TICK_TIMER_CNT TCNT0L                          /* Timer 0 counter (ATtinyX61: low byte)    */
+#else
+#define TICK_TIMER_CNT TCNT0                           /* Timer 0 counter                          */
+#endif /* TCNT0L */
+#if defined(TIFR0)
+#define TICK_TIMER_IFR TIFR0                           /* Timer 0 interrupt flag register          */
+#else
+#define TICK_TIMER_IFR TIFR                            /* Timer 0 interrupt flag register          */
+#endif /* TIFR0 */
+#if defined(TIMSK0)
+#define TICK_TIMER_IMSK TIMSK0                         /* Timer 0 interrupt mask register          */
+#else
+#define TICK_TIMER_IMSK TIMSK                          /* Timer 0 interrupt mask register          */
+#endif /* TIMSK0 */
+
+// Tick timer MSB update. GetTicks counts one timer overflow per call (every 256 ticks = 262144 CPU
+// cycles), so loops that run longer than that call it once per flash page to keep the count.
+#if USE_TICK_TIMER
+#define TICK_UPDATE() GetTicks()
+#else
+#define TICK_UPDATE()
+#endif /* USE_TICK_TIMER */
+
 // "Boot.h" patch to read the signature bytes. For some reason, the SIGRD
 // flag definition is missing in some header files, including the ATtiny85.
 #ifndef SIGRD
@@ -292,14 +646,96 @@ typedef struct m_pack {
 
 #define TML_EXT_FEATURES (EF_BIT_7 + EF_BIT_6 + EF_BIT_5 + EF_BIT_4 + EF_BIT_3 + EF_BIT_2 + EF_BIT_1 + EF_BIT_0)
 
+// Additional features code calculation for GETCAPAB replies (16 bits)
+#if (UPLOAD_JOURNAL == true)
+#define AF_BIT_0 1
+#else
+#define AF_BIT_0 0
+#endif /* UPLOAD_JOURNAL */
+#if (VERIFY_PAGE == true)
+#define AF_BIT_1 2
+#else
+#define AF_BIT_1 0
+#endif /* VERIFY_PAGE */
+#if (CMD_PATCHPAGE == true)
+#define AF_BIT_2 4
+#else
+#define AF_BIT_2 0
+#endif /* CMD_PATCHPAGE */
+#if (CMD_ERASERANGE == true)
+#define AF_BIT_3 8
+#else
+#define AF_BIT_3 0
+#endif /* CMD_ERASERANGE */
+#if (CMD_BUSTEST == true)
+#define AF_BIT_4 16
+#else
+#define AF_BIT_4 0
+#endif /* CMD_BUSTEST */
+#if (ENABLE_STATS == true)
+#define AF_BIT_5 32
+#else
+#define AF_BIT_5 0
+#endif /* ENABLE_STATS */
+#if (ENABLE_TRACE == true)
+#define AF_BIT_6 64
+#else
+#define AF_BIT_6 0
+#endif /* ENABLE_TRACE */
+#if (USI_IDLE_SLEEP == true)
+#define AF_BIT_7 128
+#else
+#define AF_BIT_7 0
+#endif /* USI_IDLE_SLEEP */
+#if (DEFER_TPL_COMMIT == true)
+#define AF_BIT_8 256
+#else
+#define AF_BIT_8 0
+#endif /* DEFER_TPL_COMMIT */
+#if (VERIFY_IMAGE == true)
+#define AF_BIT_9 512
+#else
+#define AF_BIT_9 0
+#endif /* VERIFY_IMAGE */
+#if (WRITPAGE_VARLEN == true)
+#define AF_BIT_10 1024
+#else
+#define AF_BIT_10 0
+#endif /* WRITPAGE_VARLEN */
+#if (BATCH_WRITES == true)
+#define AF_BIT_11 2048
+#else
+#define AF_BIT_11 0
+#endif /* BATCH_WRITES */
+
+#if (TWI_APP_API == true)
+#define AF_BIT_12 4096
+#else
+#define AF_BIT_12 0
+#endif /* TWI_APP_API */
+
+#if (USI_STOP_DETECT == true)
+#define AF_BIT_13 8192
+#else
+#define AF_BIT_13 0
+#endif /* USI_STOP_DETECT */
+
+#define TML_ADD_FEATURES (AF_BIT_13 + AF_BIT_12 + AF_BIT_11 + AF_BIT_10 + AF_BIT_9 + AF_BIT_8 + AF_BIT_7 + AF_BIT_6 + AF_BIT_5 + AF_BIT_4 + AF_BIT_3 + AF_BIT_2 + AF_BIT_1 + AF_BIT_0)
+
 /////////////////////////////////////////////////////////////////////////////
 ////////////      ALL USI TWI DRIVER CONFIG BELOW THIS LINE      ////////////
 /////////////////////////////////////////////////////////////////////////////
 
 // Driver buffer definitions
-// Allowed RX buffer sizes: 1, 2, 4, 8, 16, 32, 64, 128 or 256
+// Allowed RX buffer sizes: 1, 2, 4, 8, 16, 32, 64, 128 or 256. Each command is received
+// starting at the beginning of the RX buffer, so it must hold a whole WRITPAGE frame. The
+// last byte is never filled: a frame that long is rejected (the byte count is 8-bit).
 #ifndef TWI_RX_BUFFER_SIZE
+#if (MST_PACKET_SIZE > 64)
+#define TWI_RX_BUFFER_SIZE 256
+#else
 #define TWI_RX_BUFFER_SIZE 128
+#endif /* MST_PACKET_SIZE > 64 */
 #endif /* TWI_RX_BUFFER_SIZE */
 
 #define TWI_RX_BUFFER_MASK (TWI_RX_BUFFER_SIZE - 1)
@@ -319,151 +755,43 @@ typedef struct m_pack {
 #error TWI TX buffer size is not a power of 2
 #endif /* TWI_TX_BUFFER_SIZE & TWI_TX_BUFFER_MASK */
 
+// USI TWI driver hardware mapping, overflow handler states, basic operations and prototypes
+#include "timonel-usi.h"
+
+// The probes share the port with the USI TWI pins on all the supported devices
+#if (ENABLE_PROBES && ((PROBE_TWI_PIN > PROBE_PIN_MAX) || (PROBE_OVF_PIN > PROBE_PIN_MAX) || (PROBE_SPM_PIN > PROBE_PIN_MAX)))
+#error A GPIO probe pin is not available on this device, please check PROBE_TWI_PIN, PROBE_OVF_PIN and PROBE_SPM_PIN
+#endif /* PROBE_PIN_MAX */
+#if (ENABLE_PROBES && ((PROBE_TWI_PIN == PORT_USI_SDA) || (PROBE_TWI_PIN == PORT_USI_SCL) || \
+                       (PROBE_OVF_PIN == PORT_USI_SDA) || (PROBE_OVF_PIN == PORT_USI_SCL) || \
+                       (PROBE_SPM_PIN == PORT_USI_SDA) || (PROBE_SPM_PIN == PORT_USI_SCL)))
+#error A GPIO probe pin is a USI TWI pin (SDA or SCL), please move it
+#endif /* PORT_USI_SDA || PORT_USI_SCL */
+#if (ENABLE_PROBES && ((PROBE_TWI_PIN == PROBE_OVF_PIN) || (PROBE_TWI_PIN == PROBE_SPM_PIN) || (PROBE_OVF_PIN == PROBE_SPM_PIN)))
+#error The GPIO probe pins must be different
+#endif /* PROBE_TWI_PIN, PROBE_OVF_PIN, PROBE_SPM_PIN */
+
 // Pointer-to-function type
 typedef void (*const fptr_t)(void);
 
-// USI TWI driver operational modes
-typedef enum {
-    STATE_CHECK_RECEIVED_ADDRESS = 0,
-    STATE_SEND_DATA_BYTE = 1,
-    STATE_RECEIVE_ACK_AFTER_SENDING_DATA = 2,
-    STATE_CHECK_RECEIVED_ACK = 3,
-    STATE_RECEIVE_DATA_BYTE = 4,
-    STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK = 5
-} OverflowState;
-
 // USI TWI driver globals
 static uint8_t rx_buffer[TWI_RX_BUFFER_SIZE];
 static uint8_t tx_buffer[TWI_TX_BUFFER_SIZE];
-static uint8_t rx_byte_count = 0;  // Bytes received in RX buffer
-static uint8_t rx_head = 0, rx_tail = 0;
-static uint8_t tx_head = 0, tx_tail = 0;
-static OverflowState device_state;
-
-// USI TWI hardware mapping
-// ------------------------
-// DDR_USI = I2C data direction register
-// PORT_USI = I2C output register
-// PIN_USI = I2C input register
-// PORT_USI_SDA = I2C SDA output register
-// PORT_USI_SCL = I2C SCL output register
-// PIN_USI_SDA = I2C SDA input register
-// PIN_USI_SCL = I2C SDL input register
-// TWI_START_COND_FLAG = Status register flag: indicates an I2C START condition on the bus (can trigger an interrupt)
-// USI_OVERFLOW_FLAG = Status register flag: indicates a complete bit reception/transmission (can trigger an interrupt)
-// TWI_STOP_COND_FLAG = Status register flag: indicates an I2C STOP condition on the bus
-// TWI_COLLISION_FLAG = Status register flag: indicates a data output collision on the bus
-// TWI_START_COND_INT = Control register bit: defines whether an I2C START condition triggers an interrupt
-// USI_OVERFLOW_INT = Control register bit: defines whether a USI 4-bit counter overflow triggers an interrupt
-
-// ATtinyX5
-#if defined(__AVR_ATtiny25__) | \
-    defined(__AVR_ATtiny45__) | \
-    defined(__AVR_ATtiny85__)
-#define DDR_USI DDRB
-#define PORT_USI PORTB
-#define PIN_USI PINB
-#define PORT_USI_SDA PB0
-#define PORT_USI_SCL PB2
-#define PIN_USI_SDA PINB0
-#define PIN_USI_SCL PINB2
-#define TWI_START_COND_FLAG USISIF
-#define USI_OVERFLOW_FLAG USIOIF
-#define TWI_STOP_COND_FLAG USIPF
-#define TWI_COLLISION_FLAG USIDC
-#define TWI_START_COND_INT USISIE
-#define USI_OVERFLOW_INT USIOIE
-#endif // ATtinyX5
-
-// ATtinyX4
-#if defined(__AVR_ATtiny24__) | \
-    defined(__AVR_ATtiny44__) | \
-    defined(__AVR_ATtiny84__)
-#define DDR_USI DDRA
-#define PORT_USI PORTA
-#define PIN_USI PINA
-#define PORT_USI_SDA PORTA6
-#define PORT_USI_SCL PORTA4
-#define PIN_USI_SDA PINA6
-#define PIN_USI_SCL PINA4
-#define TWI_START_COND_FLAG USISIF
-#define USI_OVERFLOW_FLAG USIOIF
-#define TWI_STOP_COND_FLAG USIPF
-#define TWI_COLLISION_FLAG USIDC
-#define TWI_START_COND_INT USISIE
-#define USI_OVERFLOW_INT USIOIE
-#endif
-
-// ATtinyX313
-#if defined(__AVR_ATtiny2313__) | \
-    defined(__AVR_ATtiny4313__)
-#define DDR_USI DDRB
-#define PORT_USI PORTB
-#define PIN_USI PINB
-#define PORT_USI_SDA PB5
-#define PORT_USI_SCL PB7
-#define PIN_USI_SDA PINB5
-#define PIN_USI_SCL PINB7
-#define TWI_START_COND_FLAG USISIF
-#define USI_OVERFLOW_FLAG USIOIF
-#define TWI_STOP_COND_FLAG USIPF
-#define TWI_COLLISION_FLAG USIDC
-#define TWI_START_COND_INT USISIE
-#define USI_OVERFLOW_INT USIOIE
-#endif
-
-// ATtinyX7
-#if defined(__AVR_ATtiny87__) | \
-    defined(__AVR_ATtiny167__)
-#define DDR_USI DDRB
-#define PORT_USI PORTB
-#define PIN_USI PINB
-#define PORT_USI_SDA PB0
-#define PORT_USI_SCL PB2
-#define PIN_USI_SDA PINB0
-#define PIN_USI_SCL PINB2
-#define TWI_START_COND_FLAG USISIF
-#define USI_OVERFLOW_FLAG USIOIF
-#define TWI_STOP_COND_FLAG USIPF
-#define TWI_COLLISION_FLAG USIDC
-#define TWI_START_COND_INT USISIE
-#define USI_OVERFLOW_INT USIOIE
-#endif
-
-// ATtinyX61
-#if defined(__AVR_ATtiny261__) | \
-    defined(__AVR_ATtiny461__) | \
-    defined(__AVR_ATtiny861__)
-#define DDR_USI DDRB
-#define PORT_USI PORTB
-#define PIN_USI PINB
-#define PORT_USI_SDA PB0
-#define PORT_USI_SCL PB2
-#define PIN_USI_SDA PINB0
-#define PIN_USI_SCL PINB2
-#define TWI_START_COND_FLAG USISIF
-#define USI_OVERFLOW_FLAG USIOIF
-#define TWI_STOP_COND_FLAG USIPF
-#define TWI_COLLISION_FLAG USIDC
-#define TWI_START_COND_INT USISIE
-#define USI_OVERFLOW_INT USIOIE
-#endif
-
-// ATtiny43
-#if defined(__AVR_ATtiny43U__)
-#define DDR_USI DDRB
-#define PORT_USI PORTB
-#define PIN_USI PINB
-#define PORT_USI_SDA PORTB4
-#define PORT_USI_SCL PORTB6
-#define PIN_USI_SDA PINB4
-#define PIN_USI_SCL PINB6
-#define TWI_START_COND_FLAG USISIF
-#define USI_OVERFLOW_FLAG USIOIF
-#define TWI_STOP_COND_FLAG USIPF
-#define TWI_COLLISION_FLAG USIDC
-#define TWI_START_COND_INT USISIE
-#define USI_OVERFLOW_INT USIOIE
-#endif
+static UsiTwiContext twi_ctx;  // Driver state, each command is received starting at rx_buffer[0]
+#if ENABLE_STATS
+static uint16_t start_timeouts = 0;  // Start condition handler timeouts (bus-stuck recoveries)
+static TmlStats stats;               // Bootloader statistics counters
+#endif /* ENABLE_STATS */
+#if USE_TICK_TIMER
+static uint8_t tick_timer_msb = 0;   // Tick timer overflows: ticks MSB
+#endif /* USE_TICK_TIMER */
+#if ENABLE_TRACE
+static TraceRecord trace[TRACE_SIZE];  // Event trace ring buffer
+static uint8_t trace_head = 0;         // Next record to write
+static uint8_t trace_count = 0;        // Records not drained yet
+#endif /* ENABLE_TRACE */
+#if CMD_BUSTEST
+static BusTestCount bus_test[3];     // Bus self-test counters: echo, sink and source
+#endif /* CMD_BUSTEST */
 
 #endif  // TML_CONFIG_H